@@ -0,0 +1,286 @@
+// Measures the per-call cost of the ex2 runtime hooks. Each benchmark calls
+// the hooks of libruntime in a tight loop, either one hook on its own or a
+// mix that follows a typical instrumented loop, and reports the time, the C++
+// heap allocations and the Z3 memory per call, together with the number of
+// distinct Z3 terms the symbolic state holds at the end. Every benchmark runs
+// in a forked child, so each starts from the fresh state of a new execution.
+
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <set>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "z3++.h"
+
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/Support/CommandLine.h"
+
+#include "SymbolicInterpreter.h"
+
+using namespace llvm;
+
+static cl::opt<int> NumIterations("iterations", cl::init(100000),
+                                  cl::desc("Loop iterations per benchmark"));
+static cl::opt<unsigned> BitWidth("bv", cl::init(0),
+                                  cl::desc("Bit-vector width, 0 for integers"));
+static cl::opt<bool> Simplify("simplify", cl::init(true),
+                              cl::desc("Rewrite the terms of operators"));
+static cl::opt<int> BranchBudget(
+    "branch-budget", cl::init(64),
+    cl::desc("Maximum number of constraints kept per branch, 0 for no limit"));
+static cl::opt<std::string>
+    Filter("filter", cl::init(""),
+           cl::desc("Only run the benchmarks whose name contains this"));
+
+// the state and the hooks of libruntime
+extern SymbolicInterpreter SI;
+extern "C" {
+void __DSE_Input__(int *X, int ID);
+void __DSE_Store__(int *Ptr, int ID, int Val);
+void __DSE_Load__(int Y, int *X);
+int __DSE_ICmp__(int R, int B, int Op, int LID, int LVal, int RID, int RVal);
+void __DSE_BinOp__(int R, int Op, int LID, int LVal, int RID, int RVal);
+}
+
+static long Allocations = 0;
+
+void *operator new(size_t Size) {
+  Allocations++;
+  if (void *P = std::malloc(Size ? Size : 1))
+    return P;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *P) noexcept { std::free(P); }
+void operator delete(void *P, size_t) noexcept { std::free(P); }
+
+static const int Add = llvm::Instruction::Add;
+static const int Mul = llvm::Instruction::Mul;
+static const int SRem = llvm::Instruction::SRem;
+static const int SLT = llvm::CmpInst::ICMP_SLT;
+
+// program memory of the benchmarks
+static int I, X, S;
+
+// An input whose concrete value is Val, so loops on it run to the end.
+static void makeInput(int *Ptr, int ID, int Val) {
+  SI.getInputs()[ID] = Val;
+  __DSE_Input__(Ptr, ID);
+}
+
+// A benchmark runs N iterations and returns the number of hook calls.
+struct Benchmark {
+  const char *Name;
+  long (*Run)(int N);
+};
+
+static const Benchmark Benchmarks[] = {
+    {"load/concrete",
+     [](int N) -> long {
+       for (int K = 0; K < N; K++)
+         __DSE_Load__(0, &I);
+       return N;
+     }},
+    {"load/symbolic",
+     [](int N) -> long {
+       makeInput(&X, 0, 0);
+       for (int K = 0; K < N; K++)
+         __DSE_Load__(0, &X);
+       return N;
+     }},
+    {"store/concrete",
+     [](int N) -> long {
+       for (int K = 0; K < N; K++)
+         __DSE_Store__(&I, -1, K);
+       return N;
+     }},
+    {"store/symbolic",
+     [](int N) -> long {
+       makeInput(&X, 0, 0);
+       __DSE_Load__(0, &X);
+       for (int K = 0; K < N; K++)
+         __DSE_Store__(&S, 0, X);
+       return N;
+     }},
+    {"binop/concrete",
+     [](int N) -> long {
+       for (int K = 0; K < N; K++)
+         __DSE_BinOp__(1, Add, -1, K, -1, 1);
+       return N;
+     }},
+    {"binop/symbolic",
+     [](int N) -> long {
+       // X * 3 + K on a fresh load each time, so every term is new
+       makeInput(&X, 0, 0);
+       for (int K = 0; K < N; K++) {
+         __DSE_Load__(0, &X);
+         __DSE_BinOp__(1, Mul, 0, X, -1, 3);
+         __DSE_BinOp__(2, Add, 1, X * 3, -1, K);
+       }
+       return 3L * N;
+     }},
+    {"icmp/concrete",
+     [](int N) -> long {
+       for (int K = 0; K < N; K++)
+         __DSE_ICmp__(2, 0, SLT, -1, K, -1, N);
+       return N;
+     }},
+    {"icmp/symbolic",
+     [](int N) -> long {
+       // i < X of a loop, one constraint per iteration
+       makeInput(&X, 0, INT_MAX);
+       __DSE_Load__(0, &X);
+       for (int K = 0; K < N; K++)
+         __DSE_ICmp__(2, 0, SLT, -1, K, 0, X);
+       return N;
+     }},
+    {"mix/concrete-only",
+     [](int N) -> long {
+       // for (i = 0; i < N; i++) s += i; on concrete values
+       for (I = 0; I < N; I++) {
+         __DSE_Load__(0, &I);
+         __DSE_ICmp__(1, 0, SLT, 0, I, -1, N);
+         __DSE_Load__(2, &S);
+         __DSE_BinOp__(3, Add, 2, S, 0, I);
+         __DSE_Store__(&S, 3, S + I);
+         S += I;
+         __DSE_BinOp__(4, Add, 0, I, -1, 1);
+         __DSE_Store__(&I, 4, I + 1);
+       }
+       return 7L * N;
+     }},
+    {"mix/symbolic-chain",
+     [](int N) -> long {
+       // s = (s * 3 + i) % 1009; a term that grows in every iteration
+       makeInput(&S, 0, 1);
+       for (int K = 0; K < N; K++) {
+         int M = S * 3;
+         int E = M + K;
+         __DSE_Load__(0, &S);
+         __DSE_BinOp__(1, Mul, 0, S, -1, 3);
+         __DSE_BinOp__(2, Add, 1, M, -1, K);
+         __DSE_BinOp__(3, SRem, 2, E, -1, 1009);
+         __DSE_Store__(&S, 3, E % 1009);
+         S = E % 1009;
+       }
+       return 5L * N;
+     }},
+    {"mix/loop",
+     [](int N) -> long {
+       // for (i = 0; i < x; i++) s = s + i; with s starting as x
+       makeInput(&X, 0, INT_MAX);
+       __DSE_Load__(0, &X);
+       __DSE_Store__(&S, 0, X);
+       S = X;
+       for (I = 0; I < N; I++) {
+         __DSE_Load__(1, &I);
+         __DSE_Load__(2, &X);
+         __DSE_ICmp__(3, 0, SLT, 1, I, 2, X);
+         __DSE_Load__(4, &S);
+         __DSE_BinOp__(5, Add, 4, S, 1, I);
+         __DSE_Store__(&S, 5, S + I);
+         S += I;
+         __DSE_BinOp__(6, Add, 1, I, -1, 1);
+         __DSE_Store__(&I, 6, I + 1);
+       }
+       return 8L * N;
+     }},
+};
+
+struct Result {
+  long Ops;
+  double Seconds;
+  long Allocations;
+  int64_t Z3Bytes;
+  long Terms;
+};
+
+// the number of distinct terms reachable from the symbolic state
+static long countTerms() {
+  std::vector<z3::expr> Stack;
+  for (const SymValue &V : SI.getRegisters()) {
+    if (V.isSymbolic())
+      Stack.push_back(V.getExpr());
+  }
+  for (auto &E : SI.getMemory().getCells())
+    Stack.push_back(E.second);
+  for (auto &E : SI.getPathCondition())
+    Stack.push_back(E.second);
+  std::set<unsigned> Seen;
+  while (!Stack.empty()) {
+    z3::expr E = Stack.back();
+    Stack.pop_back();
+    if (!Seen.insert(E.id()).second || !E.is_app())
+      continue;
+    for (unsigned K = 0; K < E.num_args(); K++)
+      Stack.push_back(E.arg(K));
+  }
+  return Seen.size();
+}
+
+static Result measure(const Benchmark &B) {
+  SI.setBitWidth(BitWidth);
+  SI.setSimplify(Simplify);
+  SI.setBranchBudget(BranchBudget);
+  long Allocated = Allocations;
+  uint64_t Z3Allocated = Z3_get_estimated_alloc_size();
+  auto Start = std::chrono::steady_clock::now();
+  Result R;
+  R.Ops = B.Run(NumIterations);
+  std::chrono::duration<double> Elapsed =
+      std::chrono::steady_clock::now() - Start;
+  R.Seconds = Elapsed.count();
+  R.Allocations = Allocations - Allocated;
+  R.Z3Bytes = (int64_t)(Z3_get_estimated_alloc_size() - Z3Allocated);
+  R.Terms = countTerms();
+  return R;
+}
+
+// Runs B in a child process. Returns false if the child failed.
+static bool run(const Benchmark &B, Result &R) {
+  int Pipe[2];
+  if (pipe(Pipe))
+    return false;
+  pid_t Pid = fork();
+  if (Pid == 0) {
+    close(Pipe[0]);
+    R = measure(B);
+    bool Written = write(Pipe[1], &R, sizeof(R)) == sizeof(R);
+    _exit(Written ? 0 : 1);
+  }
+  close(Pipe[1]);
+  bool Read = Pid > 0 && read(Pipe[0], &R, sizeof(R)) == sizeof(R);
+  close(Pipe[0]);
+  int Status;
+  if (Pid > 0)
+    waitpid(Pid, &Status, 0);
+  return Read;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv,
+                              "Per-call cost of the ex2 runtime hooks\n");
+  std::printf("%-20s %10s %10s %12s %14s %10s\n", "benchmark", "calls",
+              "ns/call", "allocs/call", "z3-bytes/call", "terms");
+  for (const Benchmark &B : Benchmarks) {
+    if (std::string(B.Name).find(Filter) == std::string::npos)
+      continue;
+    Result R;
+    if (!run(B, R)) {
+      std::printf("%-20s failed\n", B.Name);
+      continue;
+    }
+    double Ops = R.Ops ? (double)R.Ops : 1;
+    std::printf("%-20s %10ld %10.1f %12.2f %14.1f %10ld\n", B.Name, R.Ops,
+                R.Seconds * 1e9 / Ops, R.Allocations / Ops, R.Z3Bytes / Ops,
+                R.Terms);
+  }
+  return 0;
+}
@@ -0,0 +1,161 @@
+// Compares the query latency of the integer and the bit-vector encodings of
+// ex2. Random straight-line programs over a few inputs are executed by the
+// SymbolicInterpreter in each encoding, and every branch on their path is
+// negated like the driver does. All encodings see the same programs, inputs
+// and queries.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "z3++.h"
+
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/Support/CommandLine.h"
+
+#include "Strategy.h"
+#include "SymbolicInterpreter.h"
+
+using namespace llvm;
+
+static cl::opt<int> NumPrograms("programs", cl::init(10),
+                                cl::desc("Number of random programs"));
+static cl::opt<int> Length("length", cl::init(30),
+                           cl::desc("Instructions per program"));
+static cl::opt<int> NumInputs("inputs", cl::init(4),
+                              cl::desc("Inputs per program"));
+static cl::opt<unsigned> Seed("seed", cl::init(1), cl::desc("Random seed"));
+static cl::opt<unsigned> Timeout("timeout", cl::init(10000),
+                                 cl::desc("Timeout per query in ms"));
+
+// An instruction of a random program: a binary operator, or a comparison
+// that ends up on the path as a branch. Operands below the number of inputs
+// are inputs, the others are earlier results or constants.
+struct Instr {
+  bool IsCmp;
+  int Op;
+  int L;
+  int R;
+  int Constant;
+};
+
+static std::vector<Instr> generate(std::mt19937 &Rand) {
+  static const int BinOps[] = {
+      llvm::Instruction::Add,  llvm::Instruction::Sub,
+      llvm::Instruction::Mul,  llvm::Instruction::SDiv,
+      llvm::Instruction::SRem, llvm::Instruction::Add};
+  static const int Preds[] = {llvm::CmpInst::ICMP_EQ, llvm::CmpInst::ICMP_NE,
+                              llvm::CmpInst::ICMP_SGT, llvm::CmpInst::ICMP_SLT,
+                              llvm::CmpInst::ICMP_SGE, llvm::CmpInst::ICMP_SLE};
+  std::vector<Instr> Program;
+  int NumValues = NumInputs;
+  for (int I = 0; I < Length; I++) {
+    Instr In;
+    In.IsCmp = Rand() % 3 == 0;
+    In.Op = In.IsCmp ? Preds[Rand() % 6] : BinOps[Rand() % 6];
+    In.L = Rand() % NumValues;
+    // compare or combine with a constant half of the time
+    In.R = Rand() % 2 ? (int)(Rand() % NumValues) : -1;
+    In.Constant = (int)(Rand() % 201) - 100;
+    Program.push_back(In);
+    if (!In.IsCmp)
+      NumValues++;
+  }
+  return Program;
+}
+
+// Runs Program on Inputs and returns the path condition.
+static std::vector<z3::expr> execute(SymbolicInterpreter &SI,
+                                     const std::vector<Instr> &Program,
+                                     const std::vector<int> &Inputs) {
+  for (int I = 0; I < NumInputs; I++) {
+    uintptr_t Addr = 0x1000 + 4 * I;
+    SI.visitInput(Addr, I, Inputs[I]);
+    SI.visitLoad(I, Addr, Inputs[I]);
+  }
+  int Next = NumInputs;
+  int Cmp = Next + Length;
+  for (unsigned I = 0; I < Program.size(); I++) {
+    const Instr &In = Program[I];
+    int LVal = SI.getRegister(In.L).getConcrete();
+    int RID = In.R;
+    int RVal = RID < 0 ? In.Constant : SI.getRegister(RID).getConcrete();
+    if (In.IsCmp)
+      SI.visitICmp(Cmp++, I, In.Op, In.L, LVal, RID, RVal);
+    else
+      SI.visitBinOp(Next++, In.Op, In.L, LVal, RID, RVal);
+  }
+  std::vector<z3::expr> Path;
+  for (auto &E : SI.getPathCondition()) {
+    Path.push_back(E.second);
+  }
+  return Path;
+}
+
+struct Stats {
+  int Queries = 0;
+  int Sat = 0;
+  int Unsat = 0;
+  int Unknown = 0;
+  double Total = 0;
+  double Max = 0;
+};
+
+static Stats run(unsigned BitWidth) {
+  std::mt19937 Rand(Seed);
+  Stats S;
+  for (int P = 0; P < NumPrograms; P++) {
+    std::vector<Instr> Program = generate(Rand);
+    std::vector<int> Inputs;
+    for (int I = 0; I < NumInputs; I++) {
+      Inputs.push_back((int)(Rand() % 2001) - 1000);
+    }
+    z3::context Ctx;
+    SymbolicInterpreter SI(Ctx);
+    SI.setBitWidth(BitWidth);
+    std::vector<z3::expr> Path = execute(SI, Program, Inputs);
+
+    // the solver of dse -bv=BitWidth -solver-timeout=Timeout
+    z3::solver Solver =
+        SymbolicInterpreter::makeSolver(Ctx, BitWidth, Timeout);
+    for (unsigned I = 0; I < Path.size(); I++) {
+      Solver.reset();
+      for (unsigned J = 0; J < I; J++) {
+        Solver.add(Path[J]);
+      }
+      Solver.add(negate(Path[I]));
+      auto Start = std::chrono::steady_clock::now();
+      z3::check_result Result = Solver.check();
+      std::chrono::duration<double> Elapsed =
+          std::chrono::steady_clock::now() - Start;
+      S.Queries++;
+      S.Total += Elapsed.count();
+      S.Max = std::max(S.Max, Elapsed.count());
+      if (Result == z3::sat)
+        S.Sat++;
+      else if (Result == z3::unsat)
+        S.Unsat++;
+      else
+        S.Unknown++;
+    }
+  }
+  return S;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv,
+                              "Query latency of the ex2 value encodings\n");
+  std::printf("%-8s %8s %6s %6s %8s %10s %10s %10s\n", "theory", "queries",
+              "sat", "unsat", "unknown", "total(s)", "mean(ms)", "max(ms)");
+  for (unsigned BitWidth : {0u, 32u}) {
+    Stats S = run(BitWidth);
+    std::string Name = BitWidth ? "bv" + std::to_string(BitWidth) : "int";
+    std::printf("%-8s %8d %6d %6d %8d %10.3f %10.3f %10.3f\n", Name.c_str(),
+                S.Queries, S.Sat, S.Unsat, S.Unknown, S.Total,
+                S.Queries ? S.Total * 1000 / S.Queries : 0.0, S.Max * 1000);
+  }
+  return 0;
+}
@@ -0,0 +1,59 @@
+# Generates a target of DEPTH nested branches over NINPUTS inputs:
+#
+#   awk -v DEPTH=16 [-v NINPUTS=4] [-v SEED=1] -f gen.awk > gen16.c
+#
+# Every branch compares a linear term of two inputs with a constant and holds
+# for one hidden assignment of the inputs, so the crash in the innermost
+# branch is reachable. Each level has a side branch on a single input as
+# well. The same parameters generate the same program.
+BEGIN {
+  if (!NINPUTS)
+    NINPUTS = 4
+  srand(SEED ? SEED : DEPTH)
+  for (i = 0; i < NINPUTS; i++)
+    V[i] = int(rand() * 2001) - 1000
+
+  print "#include <stdlib.h>"
+  print ""
+  print "#include \"../../include/Runtime.h\""
+  print ""
+  printf "// generated by gen.awk, DEPTH=%d NINPUTS=%d\n", DEPTH, NINPUTS
+  print "int main() {"
+  for (i = 0; i < NINPUTS; i++)
+    printf "  int x%d;\n  DSE_Input(x%d);\n", i, i
+  print ""
+  print "  int side = 0;"
+  Indent = "  "
+  for (D = 0; D < DEPTH; D++) {
+    A = int(rand() * NINPUTS)
+    B = int(rand() * NINPUTS)
+    CA = int(rand() * 9) + 1
+    CB = int(rand() * 19) - 9
+    Val = CA * V[A] + CB * V[B]
+    Op = int(rand() * 4)
+    if (Op == 0) {
+      Pred = "=="
+      K = Val
+    } else if (Op == 1) {
+      Pred = "!="
+      K = Val + 1 + int(rand() * 5)
+    } else if (Op == 2) {
+      Pred = "<"
+      K = Val + 1 + int(rand() * 50)
+    } else {
+      Pred = ">"
+      K = Val - 1 - int(rand() * 50)
+    }
+    printf "%sif (x%d > %d)\n%s  side++;\n", Indent, int(rand() * NINPUTS),
+           int(rand() * 2001) - 1000, Indent
+    printf "%sif (%d * x%d + %d * x%d %s %d) {\n", Indent, CA, A, CB, B, Pred, K
+    Indent = Indent "  "
+  }
+  printf "%sabort();\n", Indent
+  for (D = DEPTH; D > 0; D--) {
+    Indent = substr(Indent, 3)
+    printf "%s}\n", Indent
+  }
+  print "  return 0;"
+  print "}"
+}
@@ -0,0 +1,50 @@
+#include <stdlib.h>
+
+#include "../../include/Runtime.h"
+
+#define CHECK(x, v)                                                            \
+  if ((x) == (v) * 7 - 3)                                                      \
+    hits++
+
+// Sixteen inputs with a branch each; the crash needs all of them.
+int main() {
+  int x0, x1, x2, x3, x4, x5, x6, x7;
+  int x8, x9, x10, x11, x12, x13, x14, x15;
+  DSE_Input(x0);
+  DSE_Input(x1);
+  DSE_Input(x2);
+  DSE_Input(x3);
+  DSE_Input(x4);
+  DSE_Input(x5);
+  DSE_Input(x6);
+  DSE_Input(x7);
+  DSE_Input(x8);
+  DSE_Input(x9);
+  DSE_Input(x10);
+  DSE_Input(x11);
+  DSE_Input(x12);
+  DSE_Input(x13);
+  DSE_Input(x14);
+  DSE_Input(x15);
+
+  int hits = 0;
+  CHECK(x0, 0);
+  CHECK(x1, 1);
+  CHECK(x2, 2);
+  CHECK(x3, 3);
+  CHECK(x4, 4);
+  CHECK(x5, 5);
+  CHECK(x6, 6);
+  CHECK(x7, 7);
+  CHECK(x8, 8);
+  CHECK(x9, 9);
+  CHECK(x10, 10);
+  CHECK(x11, 11);
+  CHECK(x12, 12);
+  CHECK(x13, 13);
+  CHECK(x14, 14);
+  CHECK(x15, 15);
+  if (hits == 16)
+    abort();
+  return 0;
+}
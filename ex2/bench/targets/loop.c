@@ -0,0 +1,21 @@
+#include <stdlib.h>
+
+#include "../../include/Runtime.h"
+
+// The crash needs a particular number of loop iterations, so every
+// iteration count up to it is a path of its own.
+int main() {
+  int n, k;
+  DSE_Input(n);
+  DSE_Input(k);
+
+  int s = 0;
+  for (int i = 0; i < n && i < 100; i++) {
+    s += i;
+    if (i == k)
+      s += 3;
+  }
+  if (s == 1278 && k > 40)
+    abort();
+  return 0;
+}
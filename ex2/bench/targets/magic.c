@@ -0,0 +1,22 @@
+#include <stdlib.h>
+
+#include "../../include/Runtime.h"
+
+// Comparisons against 32-bit magic values, which random mutation hardly
+// ever hits.
+int main() {
+  int x, y, z;
+  DSE_Input(x);
+  DSE_Input(y);
+  DSE_Input(z);
+
+  if (x == 0x1badb002) {
+    if (y * 3 + 1 == 0x12345679) {
+      if ((z ^ x) == 0x0defaced) {
+        if (x - y != z)
+          abort();
+      }
+    }
+  }
+  return 0;
+}
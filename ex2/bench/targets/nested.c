@@ -0,0 +1,43 @@
+#include <stdlib.h>
+
+#include "../../include/Runtime.h"
+
+// Twelve levels of branches on arithmetic over six inputs, with a side
+// branch at every level.
+int main() {
+  int a, b, c, d, e, f;
+  DSE_Input(a);
+  DSE_Input(b);
+  DSE_Input(c);
+  DSE_Input(d);
+  DSE_Input(e);
+  DSE_Input(f);
+
+  int side = 0;
+  if (a > 10) {
+    if (b < a - 3) {
+      if (c == a + b) {
+        side += c > 100;
+        if (d > c * 2) {
+          if (e - d == 7) {
+            side += e % 2;
+            if (f < 0) {
+              if (f * 3 > -60) {
+                if (a + f == b) {
+                  side += a > 50;
+                  if (d < 1000) {
+                    if (e != 500) {
+                      if (side == 2)
+                        abort();
+                    }
+                  }
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  return 0;
+}
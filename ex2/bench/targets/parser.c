@@ -0,0 +1,22 @@
+#include <stdlib.h>
+
+#include "../../include/Runtime.h"
+
+// A record parser on a byte buffer: a magic header, a length and a payload
+// whose checksum must match.
+int main() {
+  char buf[12];
+  DSE_InputBuffer(buf, 12);
+
+  if (buf[0] != 'D' || buf[1] != 'S' || buf[2] != 'E' || buf[3] != '1')
+    return 0;
+  int len = buf[4];
+  if (len < 2 || len > 6)
+    return 0;
+  int sum = 0;
+  for (int i = 0; i < len; i++)
+    sum += buf[5 + i];
+  if (sum == buf[11] * 2 && buf[5] == '!')
+    abort();
+  return 0;
+}
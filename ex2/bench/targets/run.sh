@@ -0,0 +1,99 @@
+#!/bin/bash
+# Runs dse on every target under every configuration and writes
+#
+#   results/summary.tsv  per run: the outcome, the iterations, the seconds
+#                        to the first crash, the executions and executions
+#                        per second, the share of the time spent in the
+#                        solver and the branch sides covered
+#   results/curves.tsv   per run: the seconds, executions and branch sides
+#                        covered at every increase of the coverage
+#
+# Rows are sorted and numbers rounded, so that the results of two builds can
+# be compared with diff. The files of each run are kept in results/work.
+#
+#   ./run.sh [-t seconds] [target ...]
+#
+# CONFIGS overrides the configurations, name=flags pairs separated by spaces,
+# and DSE the driver.
+
+set -u
+cd "$(dirname "$0")"
+
+TIMEOUT=60
+if [ "${1:-}" = "-t" ]; then
+  TIMEOUT=$2
+  shift 2
+fi
+TARGETS=${*:-$(sed -n 's/^TARGETS=//p' Makefile)}
+CONFIGS=${CONFIGS:-"base= trace=-trace fork=-fork bv32=-bv=32 fuzz=-fuzz \
+j4=-j=4"}
+DSE=$(realpath "${DSE:-../../build/dse}")
+LIB=$(realpath ../../build)
+export LD_LIBRARY_PATH=$LIB${LD_LIBRARY_PATH:+:$LD_LIBRARY_PATH}
+
+make -s $TARGETS || exit 1
+rm -rf results
+mkdir -p results/work
+
+# the value of a top-level field of dse-stats.json
+field() {
+  sed -n "s/^  \"$1\": \([^,]*\),\{0,1\}$/\1/p" dse-stats.json
+}
+
+round() {
+  awk -v V="$1" \
+    'BEGIN { if (V == "" || V == "null") print "-"; else printf "%.2f\n", V }'
+}
+
+SUMMARY=results/summary.tmp
+CURVES=results/curves.tmp
+for T in $TARGETS; do
+  for C in $CONFIGS; do
+    NAME=${C%%=*}
+    FLAGS=${C#*=}
+    DIR=results/work/$T-$NAME
+    mkdir -p "$DIR"
+    (
+      cd "$DIR"
+      timeout -k 5 "$TIMEOUT" "$DSE" -stats-interval=0.5 $FLAGS \
+        "$(realpath ../../../$T)" > dse.out 2>&1
+      RET=$?
+      if grep -q "^Crashing input found" dse.out; then
+        OUTCOME=crash
+      elif grep -q "^All paths explored" dse.out; then
+        OUTCOME=explored
+      elif [ $RET = 124 ]; then
+        OUTCOME=timeout
+      else
+        OUTCOME=error
+      fi
+      ITERS=$(sed -n 's/.*(\([0-9]*\) iters.*/\1/p' dse.out | tail -1)
+      if [ ! -f dse-stats.json ]; then
+        printf "%s\t%s\t%s\t%s\t-\t-\t-\t-\t-\n" "$T" "$NAME" "$OUTCOME" \
+          "${ITERS:--}"
+        exit
+      fi
+      printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" "$T" "$NAME" "$OUTCOME" \
+        "${ITERS:--}" "$(round "$(field time_to_crash)")" \
+        "$(field executions)" "$(round "$(field executions_per_sec)")" \
+        "$(round "$(field solver_share)")" "$(field covered_branch_sides)"
+      P='s/^ *{"elapsed": \(.*\), "executions": \(.*\), "covered": \(.*\)}.*'
+      sed -n "$P/\1 \2 \3/p" dse-stats.json | while read -r E X V; do
+        printf "%s\t%s\t%s\t%s\t%s\n" "$T" "$NAME" "$(round "$E")" "$X" "$V" \
+          >> ../../curves.tmp
+      done
+    ) >> $SUMMARY
+    tail -1 $SUMMARY
+  done
+done
+
+{
+  printf "target\tconfig\toutcome\titers\tcrash_s\texecs\texecs_per_s\t"
+  printf "solver_share\tcovered\n"
+  sort $SUMMARY
+} > results/summary.tsv
+{
+  printf "target\tconfig\telapsed_s\texecs\tcovered\n"
+  sort -k1,2 -s ${CURVES} 2>/dev/null
+} > results/curves.tsv
+rm -f $SUMMARY $CURVES
@@ -0,0 +1,57 @@
+#ifndef COUNTEREXAMPLE_CACHE_H
+#define COUNTEREXAMPLE_CACHE_H
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "z3++.h"
+
+// concrete assignment of the symbolic inputs, e.g. X0 -> 42
+using ModelTy = std::map<std::string, int>;
+
+// A KLEE-style counterexample cache that sits in front of the solver. Queries
+// are conjunctions of constraints and are identified by the set of their AST
+// ids, so the constraints of every cached query are kept alive by the cache.
+class CounterexampleCache {
+public:
+  CounterexampleCache(z3::context &Ctx) : Ctx(Ctx) {}
+
+  // Answers Query from the cache if possible. On a hit, Result is set and, for
+  // sat results, Model holds an assignment satisfying Query.
+  bool lookup(const z3::expr_vector &Query, z3::check_result &Result,
+              ModelTy &Model);
+  // Records the solver answer for Query, which took Time seconds.
+  void insert(const z3::expr_vector &Query, z3::check_result Result,
+              const ModelTy &Model, double Time);
+  // adds the statistics of Other, e.g. the cache of another worker
+  void mergeStats(const CounterexampleCache &Other);
+  void print(std::ostream &OS);
+
+private:
+  struct Entry {
+    std::vector<unsigned> Key;
+    z3::expr_vector Constraints;
+    bool Sat;
+    ModelTy Model;
+  };
+
+  std::vector<unsigned> getKey(const z3::expr_vector &Query);
+  bool satisfies(const ModelTy &Model, const z3::expr_vector &Query);
+
+  z3::context &Ctx;
+  std::vector<Entry> Entries;
+  std::map<std::vector<unsigned>, size_t> Exact;
+
+  int Queries = 0;
+  int ExactHits = 0;
+  int UnsatSubsetHits = 0;
+  int SatSupersetHits = 0;
+  int ModelHits = 0;
+  int Misses = 0;
+  double SolveTime = 0;
+  double LookupTime = 0;
+};
+
+#endif // COUNTEREXAMPLE_CACHE_H
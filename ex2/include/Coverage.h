@@ -0,0 +1,42 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <cstddef>
+#include <cstdint>
+
+static const char *CoverageFile = "coverage.bin";
+
+// Branch coverage shared by the program and the driver through a mapped
+// file, with one byte per side of a branch. The program sets the byte of
+// every side it takes, the driver compares the map with the sides it has
+// seen before and clears it between executions.
+class CoverageMap {
+public:
+  static const size_t Size = 1 << 16;
+
+  CoverageMap() {}
+  CoverageMap(const CoverageMap &) = delete;
+  CoverageMap &operator=(const CoverageMap &) = delete;
+  ~CoverageMap();
+
+  // creates FileName, used by the driver
+  bool create(const char *FileName);
+  // maps an existing map, used by the program
+  bool open(const char *FileName);
+  bool isOpen() const { return Bits != nullptr; }
+  void reset();
+
+  void hit(int B, bool Taken) {
+    Bits[((unsigned)B * 2 + Taken) & (Size - 1)] = 1;
+  }
+  const uint8_t *getBits() const { return Bits; }
+  // the number of branch sides set since the last reset
+  size_t count() const;
+
+private:
+  bool map(int FD);
+
+  uint8_t *Bits = nullptr;
+};
+
+#endif // COVERAGE_H
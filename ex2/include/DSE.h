@@ -0,0 +1,64 @@
+#ifndef DSE_H
+#define DSE_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "z3++.h"
+
+#include "CounterexampleCache.h"
+#include "Stats.h"
+#include "SymbolicInterpreter.h"
+#include "Trace.h"
+
+// Helpers shared by the sequential and the parallel driver. Each driver
+// thread passes its own solver, cache and files, as Z3 contexts must not be
+// shared between threads.
+
+// A path of an execution, or of a process it forked in fork mode, with the
+// sinks met on it (see SymbolicInterpreter::getSinks) and its inputs.
+struct ExecutedPath {
+  explicit ExecutedPath(z3::context &Ctx) : Vec(Ctx) {}
+
+  z3::expr_vector Vec;
+  std::vector<std::pair<int, z3::expr>> Sinks;
+  ModelTy Inputs;
+};
+
+// the statistics of the campaign, shared by all driver threads
+extern CampaignStats Stats;
+
+// a solver for the value encoding of the driver, see -bv, with the resource
+// limits of -solver-timeout
+z3::solver makeSolver(z3::context &Ctx);
+ModelTy getModel(z3::solver &Solver);
+// the concrete inputs of the last execution, written back by the runtime
+ModelTy loadInput(const std::string &FileName = InputFile);
+void storeInput(const ModelTy &Model, const std::string &FileName = InputFile);
+
+// Solves Query, consulting the counterexample cache before the solver. A
+// query that exceeds the resource limits of the solver is unknown.
+z3::check_result solve(z3::solver &Solver, CounterexampleCache &Cache,
+                       const z3::expr_vector &Query, ModelTy &Model);
+
+// Prints the statistics and writes them to the statistics file if a report
+// is due, or if Final is set. Covered is the current branch coverage.
+void reportStats(size_t Covered, bool Final = false);
+
+// Runs Command in record mode and rebuilds the path condition and the sinks
+// of the program from its trace into Path. Returns the exit status of
+// Command.
+int runRecorded(const std::string &Command, TraceBuffer &Trace,
+                ExecutedPath &Path);
+
+// Reads and removes the paths and inputs the processes forked in fork mode
+// left in Dir, in the order of their fork IDs.
+std::vector<ExecutedPath> collectForks(z3::context &Ctx,
+                                       const std::string &Dir = ".");
+
+// Builds the query for sink I of Path: the path prefix before the sink and
+// the crash condition.
+z3::expr_vector sinkQuery(const ExecutedPath &Path, unsigned I);
+
+#endif // DSE_H
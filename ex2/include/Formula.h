@@ -0,0 +1,48 @@
+#ifndef FORMULA_H
+#define FORMULA_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "z3++.h"
+
+// Binary transfer of path conditions from the runtime to the driver. A path
+// condition is written as a DAG with one node per distinct Z3 term, in
+// topological order, so shared subterms are written and rebuilt once:
+//
+//   magic, number of nodes, nodes, number of constraints,
+//   (branch ID, node index) per constraint, number of sinks,
+//   (path prefix length, node index) per sink
+//
+// All numbers are LEB128 varints. A node is its kind followed by an input ID
+// (InputNode), a zigzag encoded value (NumeralNode), a decimal string
+// (BigNumeralNode), a Z3_decl_kind and the indices of its arguments
+// (AppNode), or for bit-vectors the width and an input ID (BVInputNode), the
+// 32-bit input sign-extended to the width, or the width and the unsigned
+// value (BVNumeralNode), or the width, 0 for an integer, and the offset of a
+// byte of the input buffer (ByteInputNode).
+enum NodeKind {
+  InputNode,
+  NumeralNode,
+  BigNumeralNode,
+  AppNode,
+  BVInputNode,
+  BVNumeralNode,
+  ByteInputNode,
+};
+
+// Writes PathCondition and Sinks to FileName. Returns false, with FileName
+// removed, if they contain a term without a binary encoding or the file
+// cannot be written.
+bool writeFormula(const std::string &FileName,
+                  const std::vector<std::pair<int, z3::expr>> &PathCondition,
+                  const std::vector<std::pair<int, z3::expr>> &Sinks);
+
+// Reads the constraints written by writeFormula into Vec, which must be
+// empty, and the sinks into Sinks. Returns false if the file is missing or
+// malformed.
+bool readFormula(const std::string &FileName, z3::expr_vector &Vec,
+                 std::vector<std::pair<int, z3::expr>> &Sinks);
+
+#endif // FORMULA_H
@@ -0,0 +1,46 @@
+#ifndef FUZZER_H
+#define FUZZER_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "CounterexampleCache.h"
+#include "Coverage.h"
+
+// The mutation fuzzer of the hybrid mode. It runs the program without
+// symbolic execution (DSE_MODE=fuzz) on mutations of the inputs in its
+// corpus, and keeps the mutations that take a branch side no execution took
+// before. The executions of the symbolic driver report their coverage to it
+// as well.
+class Fuzzer {
+public:
+  Fuzzer(const std::string &Program, CoverageMap &Coverage);
+
+  // Collects the coverage of the execution that just ran on Input. Input
+  // joins the corpus if it took a new branch side, and true is returned.
+  bool update(const ModelTy &Input);
+  // Fuzzes until Plateau executions in a row take no new branch side, and
+  // appends the inputs that did to Seeds. Returns true at the first crash,
+  // whose input is left in the input file.
+  bool run(int Plateau, std::vector<ModelTy> &Seeds);
+
+  int getExecutions() const { return Executions; }
+  size_t getCorpusSize() const { return Corpus.size(); }
+  // the number of branch sides taken by any execution
+  size_t getCovered() const { return Covered; }
+
+private:
+  ModelTy mutate(const ModelTy &Input);
+
+  std::string Command;
+  CoverageMap &Coverage;
+  std::vector<uint8_t> Seen;
+  size_t Covered = 0;
+  std::vector<ModelTy> Corpus;
+  int Executions = 0;
+  std::mt19937 Rand;
+};
+
+#endif // FUZZER_H
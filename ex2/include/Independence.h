@@ -0,0 +1,17 @@
+#ifndef INDEPENDENCE_H
+#define INDEPENDENCE_H
+
+#include <set>
+#include <string>
+
+#include "z3++.h"
+
+// Collects the names of the symbolic inputs (X0, X1, ...) that occur in E.
+void collectInputs(const z3::expr &E, std::set<std::string> &Inputs);
+
+// Returns the constraints of Query that transitively share symbolic inputs
+// with its last constraint, i.e. the independent cluster of the negated
+// branch. The other constraints do not constrain the inputs of that cluster.
+z3::expr_vector sliceQuery(const z3::expr_vector &Query);
+
+#endif // INDEPENDENCE_H
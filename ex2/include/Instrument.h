@@ -1,3 +1,4 @@
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
@@ -5,49 +6,112 @@
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 
+#include <set>
+#include <string>
+#include <vector>
+
 using namespace llvm;
 
 namespace instrument {
 
 static const char *DSEInitFunctionName = "__DSE_Init__";
+static const char *DSEModuleFunctionName = "__DSE_Module__";
+static const char *DSEInputFunctionName = "__DSE_Input__";
+static const char *DSEInputBufferFunctionName = "__DSE_InputBuffer__";
 static const char *DSEAllocaFunctionName = "__DSE_Alloca__";
 static const char *DSEStoreFunctionName = "__DSE_Store__";
 static const char *DSELoadFunctionName = "__DSE_Load__";
-static const char *DSEConstFunctionName = "__DSE_Const__";
-static const char *DSERegisterFunctionName = "__DSE_Register__";
+static const char *DSEStoreByteFunctionName = "__DSE_StoreByte__";
+static const char *DSELoadByteFunctionName = "__DSE_LoadByte__";
 static const char *DSEICmpFunctionName = "__DSE_ICmp__";
-static const char *DSEBranchFunctionName = "__DSE_Branch__";
 static const char *DSEBinOpFunctionName = "__DSE_BinOp__";
+static const char *DSEPhiFunctionName = "__DSE_Phi__";
+static const char *DSESelectFunctionName = "__DSE_Select__";
+static const char *DSECastFunctionName = "__DSE_Cast__";
+static const char *DSEArgFunctionName = "__DSE_Arg__";
+static const char *DSEParamFunctionName = "__DSE_Param__";
+static const char *DSEReturnFunctionName = "__DSE_Return__";
+static const char *DSECallResultFunctionName = "__DSE_CallResult__";
+static const char *DSEEnterFunctionName = "__DSE_Enter__";
+static const char *DSELeaveFunctionName = "__DSE_Leave__";
+
+// Over-approximates the values and memory of a module that may carry data
+// derived from a DSE_Input or DSE_InputBuffer. Everything else is concrete in
+// every execution and needs no instrumentation.
+struct InputDependence {
+  // values that may be symbolic
+  std::set<Value *> Values;
+  // allocas whose contents may be symbolic
+  std::set<Value *> Objects;
+  // allocas whose address is used other than by loads and stores
+  std::set<Value *> Escaped;
+  // functions that may return a symbolic value
+  std::set<Function *> Returns;
+  // whether memory other than non-escaping allocas may be symbolic
+  bool UnknownMemory = false;
+
+  void analyze(Module &M);
+  bool isSymbolic(Value *V) const { return Values.count(V); }
+  bool mayHoldSymbolic(Value *Ptr) const;
+  // the alloca Ptr points into, or nullptr if it cannot be tracked
+  Value *getObject(Value *Ptr) const;
+
+private:
+  bool propagate(Function &F);
+};
+
+// A dense, module-wide numbering of the registers or branches. The IDs
+// continue after the ones other modules already recorded in the map file.
+struct IDTable {
+  DenseMap<Value *, int> IDs;
+  std::vector<Value *> Values;
+  int First = 0;
 
-int RegisterID = 0;
-std::map<Value *, int> RegisterMap;
-int BranchID = 0;
-std::map<Instruction *, int> BranchMap;
-
-int getRegisterID(Value *I) {
-  if (RegisterMap.find(I) == RegisterMap.end()) {
-    RegisterMap[I] = RegisterID;
-    return RegisterID++;
-  } else {
-    return RegisterMap[I];
-  }
-}
-
-int getBranchID(Instruction *I) {
-  if (BranchMap.find(I) == BranchMap.end()) {
-    BranchMap[I] = BranchID;
-    return BranchID++;
-  } else {
-    return BranchMap[I];
-  }
-}
-
-struct Instrument : public FunctionPass {
+  int getID(Value *V);
+};
+
+struct Instrument : public ModulePass {
   static char ID;
-  static const char *checkFunctionName;
 
-  Instrument() : FunctionPass(ID) {}
+  Instrument() : ModulePass(ID) {}
+
+  bool runOnModule(Module &M) override;
+
+private:
+  void declare(Module &M);
+  void registerModule(Module &M);
+  void instrument(Function &F);
+  void instrumentPhis(BasicBlock &B);
+  void instrumentCall(CallInst *CI);
+  void addOperand(Value *V, IRBuilder<> &Builder,
+                  std::vector<Value *> &Args);
+  void readMap(Module &M, const std::string &FileName);
+  void writeMap(Module &M, const std::string &FileName);
+
+  InputDependence DA;
+  IDTable Registers;
+  IDTable Branches;
+  // map file entries of the other modules
+  std::vector<std::string> MapEntries;
 
-  bool runOnFunction(Function &F) override;
+  // runtime hooks, declared once per module
+  Function *DSEInitFunction;
+  Function *DSEModuleFunction;
+  Function *DSEAllocaFunction;
+  Function *DSEStoreFunction;
+  Function *DSELoadFunction;
+  Function *DSEStoreByteFunction;
+  Function *DSELoadByteFunction;
+  Function *DSEICmpFunction;
+  Function *DSEBinOpFunction;
+  Function *DSEPhiFunction;
+  Function *DSESelectFunction;
+  Function *DSECastFunction;
+  Function *DSEArgFunction;
+  Function *DSEParamFunction;
+  Function *DSEReturnFunction;
+  Function *DSECallResultFunction;
+  Function *DSEEnterFunction;
+  Function *DSELeaveFunction;
 };
 } // namespace instrument
@@ -0,0 +1,16 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <string>
+
+// Explores the paths of Program with NumWorkers workers, each with its own Z3
+// context and scratch directory dse-worker-<N>. An execution is a task on the
+// deque of a worker, and idle workers steal tasks from the others. Every
+// execution queues the inputs negating its unexplored branches (generational
+// search). The explored paths and covered branches are shared by all workers.
+// Stops at the first crashing input, after MaxIter executions in total, or
+// once no task is left. Returns false if the exploration failed.
+bool exploreParallel(const std::string &Program, unsigned NumWorkers,
+                     int MaxIter, bool Record, bool Fork);
+
+#endif // PARALLEL_H
@@ -1,3 +1,6 @@
 void __DSE_Input__(int *x, int ID);
+void __DSE_InputBuffer__(char *buf, int len);
 
 #define DSE_Input(x) __DSE_Input__(&x, __COUNTER__)
+// fills buf with the next len bytes of the input, each a symbolic input
+#define DSE_InputBuffer(buf, len) __DSE_InputBuffer__((char *)(buf), (len))
@@ -0,0 +1,86 @@
+#ifndef SIMPLIFIER_H
+#define SIMPLIFIER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "z3++.h"
+
+// Rewrites the terms of binary operators as the interpreter builds them.
+// Constants are folded, identities such as X * 1, X - X and X & 0 are
+// applied, and sums of constant multiples are normalized to the linear form
+// c1 * A1 + .. + cn * An + c over their atoms Ai, the inputs and the
+// subterms that are not linear. Atoms are ordered by their structural hash,
+// so equal sums get the same term on every path, and the constant comes last
+// as in X + 1.
+//
+// Z3 hash-conses terms, so a term is identified by its AST id: the linear
+// form of every term built here is kept by its id, and rewrites are memoized
+// by the operator and the ids of the operands. The tables hold on to their
+// terms, so that no id is reused while it is in a table.
+class Simplifier {
+public:
+  Simplifier(z3::context &Ctx) : Ctx(Ctx) {}
+
+  // Terms are integers for BitWidth 0, or bit-vectors of BitWidth bits whose
+  // arithmetic wraps around.
+  void setBitWidth(unsigned W);
+  // Rewrites LE Op RE, Op an llvm::Instruction opcode, into Result. Returns
+  // false if no rewrite applies. A numeral Result does not depend on the
+  // inputs.
+  bool simplify(int Op, const z3::expr &LE, const z3::expr &RE,
+                z3::expr &Result);
+  void clear();
+  // the number of terms in the tables
+  size_t size() const { return Forms.size() + Memo.size(); }
+
+private:
+  static const size_t MaxEntries = 1 << 16;
+
+  // c1 * A1 + .. + cn * An + Constant with the atoms in order
+  struct Linear {
+    Linear() : Constant(0) {}
+
+    std::vector<std::pair<z3::expr, int64_t>> Terms;
+    int64_t Constant;
+  };
+  struct Form {
+    z3::expr Term;
+    Linear L;
+  };
+  struct MemoEntry {
+    z3::expr LE;
+    z3::expr RE;
+    z3::expr Result;
+    bool Rewritten;
+  };
+  using MemoKey = std::tuple<int, unsigned, unsigned>;
+
+  bool rewrite(int Op, const z3::expr &LE, const z3::expr &RE,
+               z3::expr &Result);
+  uint64_t getMask() const {
+    return BitWidth >= 64 ? ~0ULL : (1ULL << BitWidth) - 1;
+  }
+  bool getNumeral(const z3::expr &E, int64_t &Val);
+  z3::expr makeNumeral(int64_t Val);
+  Linear getLinear(const z3::expr &E);
+  bool add(int64_t A, int64_t B, int64_t &Sum);
+  bool mul(int64_t A, int64_t B, int64_t &Product);
+  bool combine(const Linear &L, const Linear &R, int64_t Scale,
+               Linear &Result);
+  bool scale(const Linear &L, int64_t Factor, Linear &Result);
+  z3::expr build(const Linear &L);
+
+  z3::context &Ctx;
+  unsigned BitWidth = 0;
+  // the linear forms of the terms built here, by AST id
+  std::unordered_map<unsigned, Form> Forms;
+  std::map<MemoKey, MemoEntry> Memo;
+};
+
+#endif // SIMPLIFIER_H
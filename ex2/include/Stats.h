@@ -0,0 +1,96 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "z3++.h"
+
+static const char *StatsFile = "dse-stats.json";
+
+// Statistics of an exploration campaign: executions, solver queries and their
+// latencies, path condition lengths, unique paths, branch coverage over time
+// and the time to the first crash. The threads of the parallel driver share
+// one instance.
+class CampaignStats {
+public:
+  CampaignStats() : Start(std::chrono::steady_clock::now()), Last(Start) {}
+
+  // records an execution along the path condition Vec
+  void addExecution(const z3::expr_vector &Vec);
+  // records an execution of the fuzzer, which has no path condition
+  void addFuzzExecution();
+  // records a solver call that answered Result after Time seconds
+  void addQuery(z3::check_result Result, double Time);
+  // records that an execution crashed
+  void addCrash();
+  // The number of branch sides taken by any execution so far. Every increase
+  // is a point of the coverage curve.
+  void setCovered(size_t Covered);
+  // The number of threads that query the solver at once, whose solve times
+  // add up to N times the elapsed time at most.
+  void setWorkers(unsigned N) { Workers = N; }
+  // Returns true, once per Interval seconds, when a report is due.
+  bool isDue(double Interval);
+
+  // writes the numbers as one line
+  void print(std::ostream &OS);
+  // Writes the numbers as a JSON object to FileName, replacing it atomically.
+  bool write(const std::string &FileName);
+
+private:
+  struct CurvePoint {
+    double Elapsed;
+    int Executions;
+    size_t Covered;
+  };
+  struct Snapshot {
+    double Elapsed;
+    int Executions;
+    int FuzzExecutions;
+    int Queries;
+    int Sat;
+    int Unsat;
+    int Unknown;
+    double SolveTime;
+    unsigned Workers;
+    double P50, P90, P99, Max;
+    int LastLength;
+    double MeanLength;
+    int MaxLength;
+    size_t Paths;
+    size_t Covered;
+    double FirstCrash;
+    std::vector<CurvePoint> Curve;
+  };
+
+  Snapshot take();
+  double getElapsed() const;
+
+  std::mutex Lock;
+  std::chrono::steady_clock::time_point Start;
+  std::chrono::steady_clock::time_point Last;
+  int Executions = 0;
+  int FuzzExecutions = 0;
+  int Sat = 0;
+  int Unsat = 0;
+  int Unknown = 0;
+  std::vector<double> SolveTimes;
+  double SolveTime = 0;
+  unsigned Workers = 1;
+  int LastLength = 0;
+  int MaxLength = 0;
+  uint64_t TotalLength = 0;
+  std::set<uint64_t> Paths;
+  size_t Covered = 0;
+  // seconds to the first crash, negative without one
+  double FirstCrash = -1;
+  std::vector<CurvePoint> Curve;
+};
+
+#endif // STATS_H
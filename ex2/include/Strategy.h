@@ -1,3 +1,53 @@
+#ifndef STRATEGY_H
+#define STRATEGY_H
+
+#include <map>
+#include <utility>
+
 #include "z3++.h"
 
-void searchStrategy(z3::expr_vector &OldVec);
+// The explored paths and tried queries as a prefix tree of their
+// constraints. The children of a node are keyed by the AST ids of their
+// constraints, which the tree keeps alive, so two paths share a node only if
+// their constraints are the same terms. Constraints of other contexts are
+// translated into the context of the tree.
+class PathTree {
+public:
+  // the node of the empty path
+  static const unsigned Root = 0;
+
+  PathTree(z3::context &Ctx) : Ctx(Ctx), Terms(Ctx) {}
+
+  // the term E in the context of the tree
+  z3::expr import(const z3::expr &E);
+  // Returns the node of the path of node N followed by E, and sets Inserted
+  // if it was not in the tree before.
+  unsigned extend(unsigned N, const z3::expr &E, bool &Inserted);
+  unsigned extend(unsigned N, const z3::expr &E) {
+    bool Inserted;
+    return extend(N, E, Inserted);
+  }
+
+private:
+  z3::context &Ctx;
+  z3::expr_vector Terms;
+  std::map<std::pair<unsigned, unsigned>, unsigned> Children;
+};
+
+// Turns the path condition OldVec into the next query to solve. The last
+// constraint of the new query is the negated branch. Returns false once every
+// branch reachable from the explored paths has been tried.
+bool searchStrategy(z3::expr_vector &OldVec);
+
+// Records Path as executed without searching from it, e.g. the path of a
+// forked process.
+void markExplored(const z3::expr_vector &Path);
+
+// Records Query as tried, e.g. a sink query. Returns false if it was tried
+// before.
+bool markQuery(const z3::expr_vector &Query);
+
+// Negates the branch constraint E, removing an outer negation.
+z3::expr negate(const z3::expr &E);
+
+#endif // STRATEGY_H
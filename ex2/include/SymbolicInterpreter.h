@@ -1,57 +1,235 @@
 #ifndef SYMBOLIC_INTERPRETER_H
 #define SYMBOLIC_INTERPRETER_H
 
+#include <cstdint>
 #include <cstdlib>
 #include <map>
-#include <stack>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "z3++.h"
 
-static const char *FormulaFile = "formula.smt2";
+#include "Simplifier.h"
+
+static const char *FormulaFile = "formula.bin";
 static const char *InputFile = "input.txt";
+static const char *InputBufferFile = "input.bin";
 static const char *LogFile = "log.txt";
 static const char *BranchFile = "branch.txt";
+static const char *MapSuffix = ".dsemap";
+static const char *TraceFile = "trace.bin";
+
+// the file Name of the process forked as ID in fork mode, e.g. input.txt.3
+inline std::string getForkFile(const char *Name, int ID) {
+  return std::string(Name) + "." + std::to_string(ID);
+}
 
-class Address {
+// the file of the input bytes that goes with the input file FileName, e.g.
+// input.bin.3 for input.txt.3
+inline std::string getBufferFile(const std::string &FileName) {
+  std::string Name = FileName;
+  size_t Pos = Name.rfind(InputFile);
+  if (Pos == std::string::npos)
+    return Name + ".bin";
+  return Name.replace(Pos, std::string(InputFile).size(), InputBufferFile);
+}
+
+// A value of the concolic execution. The concrete value is always known, the
+// Z3 term is only built once the value depends on a DSE_Input.
+class SymValue {
 public:
-  enum Ty { Memory, Register };
-  Address(int *Ptr) : Type(Memory), Addr((uintptr_t)Ptr) {}
-  Address(int ID) : Type(Register), Addr(ID) {}
-  Address(z3::expr &R)
-      : Type(Register), Addr(std::stoll(R.to_string().substr(1))) {}
-
-  bool operator<(const Address &RHS) const {
-    return (Type < RHS.Type) || (Type == RHS.Type && Addr < RHS.Addr);
-  }
-  friend std::ostream &operator<<(std::ostream &OS, const Address &SE);
+  SymValue(z3::context &Ctx, int Concrete) : Concrete(Concrete), Expr(Ctx) {}
+  SymValue(int Concrete, const z3::expr &E) : Concrete(Concrete), Expr(E) {}
+
+  bool isSymbolic() const { return (Z3_ast)Expr != nullptr; }
+  int getConcrete() const { return Concrete; }
+  // the symbolic term of the value, see SymbolicInterpreter::toExpr for
+  // concrete values
+  const z3::expr &getExpr() const { return Expr; }
+  friend std::ostream &operator<<(std::ostream &OS, const SymValue &V);
 
 private:
-  Ty Type;
-  uintptr_t Addr;
+  int Concrete;
+  z3::expr Expr;
 };
 
-using MemoryTy = std::map<Address, z3::expr>;
+// Symbolic shadow of the program memory, split into pages of byte-addressed
+// slots. Only cells that hold a symbolic value are recorded, the concrete value
+// of a load is passed in by the caller. Stores overwrite their slot in place.
+class ShadowMemory {
+public:
+  static const int PageBits = 10;
+  static const uintptr_t PageSize = 1 << PageBits;
+
+  ShadowMemory(z3::context &Ctx) : Ctx(Ctx) {}
 
+  SymValue load(uintptr_t Addr, int Concrete);
+  void store(uintptr_t Addr, const SymValue &V);
+  void clear(uintptr_t Addr) { store(Addr, SymValue(Ctx, 0)); }
+  // the symbolic cells by address
+  std::map<uintptr_t, z3::expr> getCells() const;
+  friend std::ostream &operator<<(std::ostream &OS, const ShadowMemory &M);
+
+private:
+  std::vector<z3::expr> *getPage(uintptr_t Page, bool Create);
+
+  z3::context &Ctx;
+  std::unordered_map<uintptr_t, std::vector<z3::expr>> Pages;
+  uintptr_t LastPage = 0;
+  std::vector<z3::expr> *LastSlots = nullptr;
+};
+
+// The symbolic state of one execution. The visit methods are the transfer
+// functions of the runtime hooks; they take the concrete values the program
+// computed, so they run either inline in the program or in the driver when
+// it replays a recorded trace.
 class SymbolicInterpreter {
 public:
-  int NewInput(int *Ptr, int ID);
-  MemoryTy &getMemory() { return Mem; }
+  SymbolicInterpreter(z3::context &Ctx)
+      : Ctx(Ctx), Mem(Ctx), Return(Ctx, 0), Simp(Ctx) {}
+
+  // the concrete value of input ID, read from the input file or random
+  int NewInput(int ID);
+
+  // Values are encoded as unbounded integers for BitWidth 0, or as
+  // bit-vectors of BitWidth bits that wrap around like machine integers.
+  // The program values are 32 bits wide, so only a BitWidth of 32 matches
+  // their overflow exactly, and the driver rejects other widths. Wider
+  // inputs are sign-extended 32-bit variables.
+  void setBitWidth(unsigned W) {
+    BitWidth = W;
+    Simp.setBitWidth(W);
+  }
+  unsigned getBitWidth() const { return BitWidth; }
+  // the terms of input ID and of the concrete value Val
+  z3::expr makeInput(int ID);
+  z3::expr makeValue(int Val);
+  // The bytes of DSE_InputBuffer are inputs BOffset of the value encoding,
+  // whose low 8 bits are the byte. Bytes are held as their unsigned value,
+  // i.e. the input modulo 256, until a cast extends them.
+  z3::expr makeByteInput(int Offset);
+  z3::expr makeByte(int Offset) { return toByte(makeByteInput(Offset)); }
+  // the unsigned value of the low byte of E
+  z3::expr toByte(const z3::expr &E);
+  z3::expr toExpr(const SymValue &V) {
+    return V.isSymbolic() ? V.getExpr() : makeValue(V.getConcrete());
+  }
+  // Reads the numeral E of either encoding as a program value.
+  static bool getValue(const z3::expr &E, int &Val);
+  // the concrete outcome of the comparison Op, a CmpInst predicate
+  static bool compare(int Op, int LHS, int RHS);
+  // A solver for the value encoding of BitWidth, bit-blasting bit-vectors,
+  // with a Timeout per query in ms, 0 for none.
+  static z3::solver makeSolver(z3::context &Ctx, unsigned BitWidth,
+                               unsigned Timeout);
+
+  void visitInput(uintptr_t Addr, int ID, int Val);
+  void visitInputByte(uintptr_t Addr, int Offset, int Val);
+  void visitAlloca(int R, uintptr_t Addr);
+  void visitStore(uintptr_t Addr, int ID, int Val);
+  void visitLoad(int R, uintptr_t Addr, int Val);
+  void visitLoadByte(int R, uintptr_t Addr, int Val);
+  void visitICmp(int R, int B, int Op, int LID, int LVal, int RID, int RVal);
+  void visitBinOp(int R, int Op, int LID, int LVal, int RID, int RVal);
+  void visitPhi(int R, int ID, int Val, bool Last);
+  void visitSelect(int R, int CID, int CVal, int TID, int TVal, int FID,
+                   int FVal);
+  void visitCast(int R, int Op, int Width, int ID, int Val);
+  void visitArg(int I, int ID, int Val) { getArg(I) = operand(ID, Val); }
+  void visitParam(int R, int I, int Val) {
+    setRegister(R, take(getArg(I), Val));
+  }
+  void visitReturn(int ID, int Val) { Return = operand(ID, Val); }
+  void visitCallResult(int R, int Val) { setRegister(R, take(Return, Val)); }
+  // Registers are numbered per instruction, so a function saves its
+  // registers First, .., First + Count - 1 on entry and restores them when
+  // it returns, as a recursive call reuses them.
+  void visitEnter(int First, int Count);
+  void visitLeave();
+
+  // Terms of binary operators are rewritten by a Simplifier unless disabled,
+  // and comparisons of sums that differ by a constant are not recorded.
+  void setSimplify(bool S) { Simplify = S; }
+  Simplifier &getSimplifier() { return Simp; }
+
+  // Appends the constraint C of branch B to the path condition. With a
+  // budget, loops are compressed: a constraint that implies the last one of
+  // its branch replaces it if no constraint or sink was recorded since, e.g.
+  // i < X after 0 < X, .., i - 1 < X, and a branch keeps at most Budget
+  // constraints, dropping the rest.
+  void addConstraint(int B, const z3::expr &C);
+  // Budget 0 keeps every constraint. The budget also caps the sinks recorded
+  // per instruction.
+  void setBranchBudget(int Budget) { BranchBudget = Budget; }
+
+  ShadowMemory &getMemory() { return Mem; }
+  std::vector<SymValue> &getRegisters() { return Registers; }
+  const SymValue &getRegister(int ID) {
+    if (ID >= (int)Registers.size())
+      Registers.resize(ID + 1, SymValue(Ctx, 0));
+    return Registers[ID];
+  }
+  void setRegister(int ID, const SymValue &V) {
+    if (ID >= (int)Registers.size())
+      Registers.resize(ID + 1, SymValue(Ctx, 0));
+    Registers[ID] = V;
+  }
+  // slots passing symbolic arguments and return values between functions
+  SymValue &getArg(int I) {
+    if (I >= (int)Args.size())
+      Args.resize(I + 1, SymValue(Ctx, 0));
+    return Args[I];
+  }
+  std::map<int, uintptr_t> &getPointers() { return Pointers; }
   std::map<int, int> &getInputs() { return Inputs; }
+  // the input bytes read so far by offset
+  std::map<int, int> &getBytes() { return Bytes; }
   z3::context &getContext() { return Ctx; }
-  std::stack<z3::expr> &getStack() { return Stack; }
   std::vector<std::pair<int, z3::expr>> &getPathCondition() {
     return PathCondition;
   }
+  // the number of constraints left out of the path condition by branch ID,
+  // dropped over the budget or summarized into a stronger one
+  std::map<int, int> &getDropped() { return Dropped; }
+  std::map<int, int> &getSummarized() { return Summarized; }
+  // Conditions under which the program crashes, e.g. a symbolic divisor
+  // being zero, each with the length of the path condition it is met after.
+  // The driver solves them before negating any branch.
+  std::vector<std::pair<int, z3::expr>> &getSinks() { return Sinks; }
 
 private:
-  MemoryTy Mem;
+  SymValue operand(int ID, int Val);
+  SymValue take(SymValue &Slot, int Val);
+  void addSink(int R, const z3::expr &Cond);
+
+  z3::context &Ctx;
+  ShadowMemory Mem;
+  std::vector<SymValue> Registers;
+  std::vector<SymValue> Args;
+  SymValue Return;
+  // the first register and the saved registers of each active function
+  std::vector<std::pair<int, std::vector<SymValue>>> Frames;
+  std::vector<std::pair<int, SymValue>> PendingPhis;
+  std::map<int, uintptr_t> Pointers;
   std::map<int, int> Inputs;
+  std::map<int, int> Bytes;
   int NumOfInputs = 0;
-  std::stack<z3::expr> Stack;
   std::vector<std::pair<int, z3::expr>> PathCondition;
-
-  z3::context Ctx;
+  unsigned BitWidth = 0;
+  Simplifier Simp;
+  bool Simplify = true;
+  int BranchBudget = 0;
+  // per branch ID, the number of constraints kept and the index of the last
+  std::unordered_map<int, std::pair<int, size_t>> Kept;
+  std::map<int, int> Dropped;
+  std::map<int, int> Summarized;
+  std::vector<std::pair<int, z3::expr>> Sinks;
+  // the number of sinks recorded by register ID
+  std::unordered_map<int, int> SinkCounts;
+  // the length of the path condition at the last sink, below which no
+  // constraint is replaced
+  size_t SinkPrefix = 0;
 };
 
 #endif // SYMBOLIC_INTERPRETER_H
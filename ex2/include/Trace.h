@@ -0,0 +1,112 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+#include "SymbolicInterpreter.h"
+
+// The events of an execution trace, one per runtime hook. An event is stored
+// as its kind followed by the EventSize[Kind] words of its arguments, which
+// are the arguments of the hook plus the concrete value of loads and inputs.
+// Addresses take two words.
+enum EventKind : int32_t {
+  InputEvent,      // Addr, ID, Val
+  AllocaEvent,     // R, Addr
+  StoreEvent,      // Addr, ID, Val
+  LoadEvent,       // R, Addr, Val
+  ICmpEvent,       // R, B, Op, LID, LVal, RID, RVal
+  BinOpEvent,      // R, Op, LID, LVal, RID, RVal
+  PhiEvent,        // R, ID, Val, Last
+  SelectEvent,     // R, CID, CVal, TID, TVal, FID, FVal
+  CastEvent,       // R, Op, Width, ID, Val
+  ArgEvent,        // I, ID, Val
+  ParamEvent,      // R, I, Val
+  ReturnEvent,     // ID, Val
+  CallResultEvent, // R, Val
+  InputByteEvent,  // Addr, Offset, Val
+  LoadByteEvent,   // R, Addr, Val
+  EnterEvent,      // First, Count
+  LeaveEvent,      //
+  NumEventKinds
+};
+
+static const int EventSize[NumEventKinds] = {4, 3, 4, 4, 7, 6, 4, 7, 5,
+                                             3, 3, 2, 2, 4, 4, 2, 0};
+
+// 64M words, the file is sparse so only the written part takes up space
+static const uint64_t DefaultTraceCapacity = 1 << 26;
+
+inline int32_t addrLo(const void *Ptr) { return (int32_t)(uintptr_t)Ptr; }
+inline int32_t addrHi(const void *Ptr) {
+  return (int32_t)((uint64_t)(uintptr_t)Ptr >> 32);
+}
+inline uintptr_t toAddr(int32_t Lo, int32_t Hi) {
+  return (uintptr_t)((uint64_t)(uint32_t)Hi << 32 | (uint32_t)Lo);
+}
+
+struct TraceHeader {
+  uint32_t Magic;
+  // set once an event did not fit, the events before it are still valid
+  uint32_t Truncated;
+  uint64_t Capacity;
+  // number of words written, published after the words of each event
+  uint64_t Size;
+};
+
+// A trace file mapped into memory. The driver creates the file and the
+// program appends to it through a shared mapping, so the driver can replay
+// the events while the program is still running.
+class TraceBuffer {
+public:
+  TraceBuffer() {}
+  TraceBuffer(const TraceBuffer &) = delete;
+  TraceBuffer &operator=(const TraceBuffer &) = delete;
+  ~TraceBuffer();
+
+  // creates FileName with room for Capacity words, used by the driver
+  bool create(const char *FileName, uint64_t Capacity);
+  // maps an existing trace for appending, used by the program
+  bool open(const char *FileName);
+  bool isOpen() const { return Header != nullptr; }
+  // empties the trace before the next execution
+  void reset();
+
+  void append(EventKind Kind, std::initializer_list<int32_t> Args) {
+    if (Header->Truncated)
+      return;
+    if (Size + 1 + Args.size() > Header->Capacity) {
+      Header->Truncated = 1;
+      return;
+    }
+    Words[Size++] = Kind;
+    for (int32_t A : Args) {
+      Words[Size++] = A;
+    }
+    __atomic_store_n(&Header->Size, Size, __ATOMIC_RELEASE);
+  }
+
+  uint64_t getSize() const {
+    return __atomic_load_n(&Header->Size, __ATOMIC_ACQUIRE);
+  }
+  bool isTruncated() const { return Header->Truncated; }
+  const int32_t *getWords() const { return Words; }
+
+private:
+  bool map(int FD);
+
+  TraceHeader *Header = nullptr;
+  int32_t *Words = nullptr;
+  size_t Length = 0;
+  // the write position of the program
+  uint64_t Size = 0;
+};
+
+// Replays the events of Trace into SI. The trace is followed while the
+// program appends to it, until Done is set and all events are consumed.
+void replayTrace(const TraceBuffer &Trace, SymbolicInterpreter &SI,
+                 const std::atomic<bool> &Done);
+
+#endif // TRACE_H
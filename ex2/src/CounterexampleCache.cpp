@@ -0,0 +1,157 @@
+#include "CounterexampleCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <set>
+
+// only the most recent models are evaluated against a new query
+static const int MaxModelProbes = 64;
+
+std::vector<unsigned>
+CounterexampleCache::getKey(const z3::expr_vector &Query) {
+  std::vector<unsigned> Key;
+  for (unsigned I = 0; I < Query.size(); I++) {
+    Key.push_back(Z3_get_ast_id(Ctx, Query[I]));
+  }
+  std::sort(Key.begin(), Key.end());
+  Key.erase(std::unique(Key.begin(), Key.end()), Key.end());
+  return Key;
+}
+
+// Collects the inputs that occur in E, whose sort depends on the encoding.
+static void collectConstants(const z3::expr &E,
+                             std::map<std::string, z3::expr> &Constants,
+                             std::set<unsigned> &Visited) {
+  if (!Visited.insert(Z3_get_ast_id(E.ctx(), E)).second)
+    return;
+  if (E.is_const() && E.decl().decl_kind() == Z3_OP_UNINTERPRETED) {
+    Constants.emplace(E.decl().name().str(), E);
+    return;
+  }
+  if (E.is_app()) {
+    for (unsigned I = 0; I < E.num_args(); I++) {
+      collectConstants(E.arg(I), Constants, Visited);
+    }
+  }
+}
+
+bool CounterexampleCache::satisfies(const ModelTy &Model,
+                                    const z3::expr_vector &Query) {
+  std::map<std::string, z3::expr> Constants;
+  std::set<unsigned> Visited;
+  for (unsigned I = 0; I < Query.size(); I++) {
+    collectConstants(Query[I], Constants, Visited);
+  }
+  z3::expr_vector From(Ctx);
+  z3::expr_vector To(Ctx);
+  for (auto &E : Constants) {
+    auto It = Model.find(E.first);
+    if (It == Model.end())
+      return false;
+    From.push_back(E.second);
+    To.push_back(Ctx.num_val(It->second, E.second.get_sort()));
+  }
+  for (unsigned I = 0; I < Query.size(); I++) {
+    z3::expr E = Query[I];
+    if (!E.substitute(From, To).simplify().is_true())
+      return false;
+  }
+  return true;
+}
+
+bool CounterexampleCache::lookup(const z3::expr_vector &Query,
+                                 z3::check_result &Result, ModelTy &Model) {
+  auto Start = std::chrono::steady_clock::now();
+  Queries++;
+  std::vector<unsigned> Key = getKey(Query);
+  bool Hit = false;
+
+  auto It = Exact.find(Key);
+  if (It != Exact.end()) {
+    Entry &E = Entries[It->second];
+    Result = E.Sat ? z3::sat : z3::unsat;
+    Model = E.Model;
+    ExactHits++;
+    Hit = true;
+  }
+  // an unsatisfiable subset makes the whole query unsatisfiable, and a model
+  // of a satisfiable superset is also a model of the query
+  for (auto I = Entries.begin(); !Hit && I != Entries.end(); I++) {
+    if (!I->Sat &&
+        std::includes(Key.begin(), Key.end(), I->Key.begin(), I->Key.end())) {
+      Result = z3::unsat;
+      UnsatSubsetHits++;
+      Hit = true;
+    } else if (I->Sat && std::includes(I->Key.begin(), I->Key.end(),
+                                       Key.begin(), Key.end())) {
+      Result = z3::sat;
+      Model = I->Model;
+      SatSupersetHits++;
+      Hit = true;
+    }
+  }
+  // queries often differ only slightly from earlier ones, so an earlier
+  // model may well satisfy them too
+  int Probes = 0;
+  for (auto I = Entries.rbegin();
+       !Hit && I != Entries.rend() && Probes < MaxModelProbes; I++) {
+    if (!I->Sat)
+      continue;
+    Probes++;
+    if (satisfies(I->Model, Query)) {
+      Result = z3::sat;
+      Model = I->Model;
+      ModelHits++;
+      Hit = true;
+    }
+  }
+
+  if (!Hit)
+    Misses++;
+  std::chrono::duration<double> Elapsed =
+      std::chrono::steady_clock::now() - Start;
+  LookupTime += Elapsed.count();
+  return Hit;
+}
+
+void CounterexampleCache::insert(const z3::expr_vector &Query,
+                                 z3::check_result Result, const ModelTy &Model,
+                                 double Time) {
+  SolveTime += Time;
+  if (Result == z3::unknown)
+    return;
+  std::vector<unsigned> Key = getKey(Query);
+  if (Exact.find(Key) != Exact.end())
+    return;
+  Exact[Key] = Entries.size();
+  Entries.push_back({Key, Query, Result == z3::sat, Model});
+}
+
+void CounterexampleCache::mergeStats(const CounterexampleCache &Other) {
+  Queries += Other.Queries;
+  ExactHits += Other.ExactHits;
+  UnsatSubsetHits += Other.UnsatSubsetHits;
+  SatSupersetHits += Other.SatSupersetHits;
+  ModelHits += Other.ModelHits;
+  Misses += Other.Misses;
+  SolveTime += Other.SolveTime;
+  LookupTime += Other.LookupTime;
+}
+
+void CounterexampleCache::print(std::ostream &OS) {
+  int Hits = ExactHits + UnsatSubsetHits + SatSupersetHits + ModelHits;
+  double AvgSolveTime = Misses ? SolveTime / Misses : 0;
+  double Saved = Hits * AvgSolveTime - LookupTime;
+  OS << "=== Counterexample Cache ===" << std::endl;
+  OS << "Queries : " << Queries << std::endl;
+  OS << "Hits : " << Hits << " (" << (Queries ? 100.0 * Hits / Queries : 0)
+     << "%)" << std::endl;
+  OS << "  exact : " << ExactHits << std::endl;
+  OS << "  unsat subset : " << UnsatSubsetHits << std::endl;
+  OS << "  sat superset : " << SatSupersetHits << std::endl;
+  OS << "  model reuse : " << ModelHits << std::endl;
+  OS << "Misses : " << Misses << std::endl;
+  OS << "Solver time : " << SolveTime << "s" << std::endl;
+  OS << "Lookup time : " << LookupTime << "s" << std::endl;
+  OS << "Estimated time saved : " << Saved << "s" << std::endl;
+}
@@ -0,0 +1,45 @@
+#include "Coverage.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+CoverageMap::~CoverageMap() {
+  if (Bits)
+    munmap(Bits, Size);
+}
+
+bool CoverageMap::map(int FD) {
+  void *Addr = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, FD, 0);
+  close(FD);
+  if (Addr == MAP_FAILED)
+    return false;
+  Bits = (uint8_t *)Addr;
+  return true;
+}
+
+bool CoverageMap::create(const char *FileName) {
+  int FD = ::open(FileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (FD < 0)
+    return false;
+  if (ftruncate(FD, Size)) {
+    close(FD);
+    return false;
+  }
+  return map(FD);
+}
+
+bool CoverageMap::open(const char *FileName) {
+  int FD = ::open(FileName, O_RDWR);
+  if (FD < 0)
+    return false;
+  return map(FD);
+}
+
+void CoverageMap::reset() { std::memset(Bits, 0, Size); }
+
+size_t CoverageMap::count() const {
+  return Size - std::count(Bits, Bits + Size, 0);
+}
@@ -1,27 +1,142 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <dirent.h>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
 
 #include "z3++.h"
 
+#include "llvm/Support/CommandLine.h"
+
+#include "CounterexampleCache.h"
+#include "DSE.h"
+#include "Formula.h"
+#include "Fuzzer.h"
+#include "Independence.h"
+#include "Parallel.h"
 #include "Strategy.h"
 #include "SymbolicInterpreter.h"
+#include "Trace.h"
+
+using namespace llvm;
+
+static cl::opt<std::string> Program(cl::Positional, cl::Required,
+                                    cl::desc("<executable>"));
+static cl::opt<int> MaxIter(cl::Positional, cl::init(INT_MAX),
+                            cl::desc("[iterations]"));
+static cl::opt<bool>
+    Record("trace", cl::desc("Record a binary trace and build the path "
+                             "condition in the driver"));
+static cl::opt<bool>
+    Fork("fork", cl::desc("Fork the program at symbolic branches whose other "
+                          "side is feasible"));
+static cl::opt<int> MaxForks("max-forks", cl::init(16),
+                             cl::desc("Maximum number of live forks"));
+static cl::opt<int> BranchBudget(
+    "branch-budget", cl::init(64),
+    cl::desc("Maximum number of constraints kept per branch, 0 for no limit"));
+static cl::opt<unsigned>
+    BitWidth("bv", cl::init(0),
+             cl::desc("Encode values as 32-bit bit-vectors (-bv=32) and "
+                      "solve by bit-blasting, instead of as integers"),
+             cl::value_desc("width"));
+static cl::opt<bool>
+    Simplify("simplify", cl::init(true),
+             cl::desc("Fold constants and normalize linear terms as they are "
+                      "built (-simplify=false to build them as is)"));
+static cl::opt<bool>
+    Hybrid("fuzz", cl::desc("Fuzz the program with mutated inputs, and solve "
+                            "for new inputs once coverage stops growing"));
+static cl::opt<int>
+    Plateau("fuzz-plateau", cl::init(500),
+            cl::desc("Fuzzing executions without new coverage before the "
+                     "solver takes over"));
+static cl::opt<unsigned>
+    SolverTimeout("solver-timeout", cl::init(10000),
+                  cl::desc("Timeout per solver query in ms, 0 for none; "
+                           "queries that time out are skipped"),
+                  cl::value_desc("ms"));
+static cl::opt<unsigned> SolverMemory(
+    "solver-memory", cl::init(0),
+    cl::desc("Memory limit of Z3 in MB, 0 for none; queries that exceed it "
+             "are skipped"),
+    cl::value_desc("MB"));
+static cl::opt<double>
+    StatsInterval("stats-interval", cl::init(5),
+                  cl::desc("Seconds between two statistics reports"));
+static cl::opt<std::string>
+    StatsPath("stats-file", cl::init(StatsFile),
+              cl::desc("JSON file the statistics are written to"));
+static cl::opt<unsigned>
+    NumWorkers("j", cl::init(1),
+               cl::desc("Number of parallel executor/solver workers"),
+               cl::value_desc("workers"));
 
 z3::context Ctx;
 z3::solver Solver(Ctx);
+CounterexampleCache Cache(Ctx);
+CampaignStats Stats;
+
+z3::solver makeSolver(z3::context &Ctx) {
+  return SymbolicInterpreter::makeSolver(Ctx, BitWidth, SolverTimeout);
+}
 
-void storeInput() {
-  std::ofstream OS(InputFile);
+ModelTy getModel(z3::solver &Solver) {
+  ModelTy Result;
   z3::model Model = Solver.get_model();
   for (int I = 0; I < Model.size(); I++) {
     const z3::func_decl E = Model[I];
-    z3::expr Input = Model.get_const_interp(E);
-    if (Input.kind() == Z3_NUMERAL_AST) {
-      int I = Input.get_numeral_int();
-      OS << E.name() << "," << I << std::endl;
+    int Val;
+    if (SymbolicInterpreter::getValue(Model.get_const_interp(E), Val))
+      Result[E.name().str()] = Val;
+  }
+  return Result;
+}
+
+// The bytes of the input buffer are kept in their own raw file, and are the
+// inputs B0, B1, .. of a model.
+ModelTy loadInput(const std::string &FileName) {
+  ModelTy Inputs;
+  std::string Line;
+  std::ifstream IS(FileName);
+  while (getline(IS, Line)) {
+    Inputs[Line.substr(0, Line.find(","))] =
+        std::stoi(Line.substr(Line.find(",") + 1));
+  }
+  std::ifstream Buffer(getBufferFile(FileName), std::ios::binary);
+  char Byte;
+  for (int Offset = 0; Buffer.get(Byte); Offset++) {
+    Inputs["B" + std::to_string(Offset)] = (uint8_t)Byte;
+  }
+  return Inputs;
+}
+
+void storeInput(const ModelTy &Model, const std::string &FileName) {
+  std::ofstream OS(FileName);
+  std::string Bytes;
+  for (auto &E : Model) {
+    if (E.first[0] != 'B') {
+      OS << E.first << "," << E.second << std::endl;
+      continue;
     }
+    size_t Offset = std::stoul(E.first.substr(1));
+    if (Offset >= Bytes.size())
+      Bytes.resize(Offset + 1, '\0');
+    Bytes[Offset] = (char)E.second;
   }
+  std::string BufferFile = getBufferFile(FileName);
+  if (Bytes.empty()) {
+    std::remove(BufferFile.c_str());
+    return;
+  }
+  std::ofstream Buffer(BufferFile, std::ios::binary);
+  Buffer.write(Bytes.data(), Bytes.size());
 }
 
 void printNewPathCondition(z3::expr_vector &Vec) {
@@ -34,54 +149,306 @@ void printNewPathCondition(z3::expr_vector &Vec) {
   }
 }
 
-void generateInput() {
-  z3::expr_vector Vec = Ctx.parse_file(FormulaFile);
+z3::check_result solve(z3::solver &Solver, CounterexampleCache &Cache,
+                       const z3::expr_vector &Query, ModelTy &Model) {
+  z3::check_result Result;
+  if (Cache.lookup(Query, Result, Model)) {
+    return Result;
+  }
+  auto Start = std::chrono::steady_clock::now();
+  Solver.reset();
+  for (const auto &E : Query) {
+    Solver.add(E);
+  }
+  try {
+    Result = Solver.check();
+  } catch (const z3::exception &) {
+    // the tactic timed out or the memory limit was hit
+    Result = z3::unknown;
+  }
+  if (Result == z3::sat) {
+    Model = getModel(Solver);
+  }
+  std::chrono::duration<double> Elapsed =
+      std::chrono::steady_clock::now() - Start;
+  Cache.insert(Query, Result, Model, Elapsed.count());
+  Stats.addQuery(Result, Elapsed.count());
+  return Result;
+}
+
+void reportStats(size_t Covered, bool Final) {
+  // the coverage curve follows every execution, the reports are periodic
+  Stats.setCovered(Covered);
+  if (!Final && !Stats.isDue(StatsInterval))
+    return;
+  Stats.print(std::cout);
+  if (!Stats.write(StatsPath))
+    std::cerr << "Cannot write " << StatsPath << std::endl;
+}
+
+// The trace is replayed on a separate thread while the program runs.
+int runRecorded(const std::string &Command, TraceBuffer &Trace,
+                ExecutedPath &Path) {
+  Trace.reset();
+  SymbolicInterpreter SI(Path.Vec.ctx());
+  SI.setBranchBudget(BranchBudget);
+  SI.setBitWidth(BitWidth);
+  SI.setSimplify(Simplify);
+  std::atomic<bool> Done(false);
+  std::thread Replay([&] { replayTrace(Trace, SI, Done); });
+  int Ret = std::system(Command.c_str());
+  Done = true;
+  Replay.join();
+  if (Trace.isTruncated())
+    std::cerr << "Trace truncated, only its prefix is explored" << std::endl;
+  for (auto &E : SI.getPathCondition()) {
+    Path.Vec.push_back(E.second);
+  }
+  Path.Sinks = SI.getSinks();
+  return Ret;
+}
 
-  while (true) {
-    searchStrategy(Vec);
+std::vector<ExecutedPath> collectForks(z3::context &Ctx,
+                                       const std::string &Dir) {
+  std::vector<ExecutedPath> Forks;
+  DIR *D = opendir(Dir.c_str());
+  if (!D)
+    return Forks;
+  std::string Prefix = std::string(FormulaFile) + ".";
+  std::vector<int> IDs;
+  while (dirent *E = readdir(D)) {
+    std::string Name = E->d_name;
+    if (Name.compare(0, Prefix.size(), Prefix) == 0)
+      IDs.push_back(std::atoi(Name.c_str() + Prefix.size()));
+  }
+  closedir(D);
+  std::sort(IDs.begin(), IDs.end());
+  for (int ID : IDs) {
+    std::string Formula = Dir + "/" + getForkFile(FormulaFile, ID);
+    std::string Input = Dir + "/" + getForkFile(InputFile, ID);
+    ExecutedPath Path(Ctx);
+    if (readFormula(Formula, Path.Vec, Path.Sinks)) {
+      Path.Inputs = loadInput(Input);
+      Forks.push_back(Path);
+    } else {
+      std::cerr << "Cannot read " << Formula << std::endl;
+    }
+    std::remove(Formula.c_str());
+    std::remove(Input.c_str());
+    std::remove(getBufferFile(Input).c_str());
+    std::remove((Dir + "/" + getForkFile(BranchFile, ID)).c_str());
+  }
+  return Forks;
+}
+
+z3::expr_vector sinkQuery(const ExecutedPath &Path, unsigned I) {
+  z3::expr_vector Query(Path.Vec.ctx());
+  int Prefix = Path.Sinks[I].first;
+  for (int J = 0; J < Prefix && J < (int)Path.Vec.size(); J++) {
+    Query.push_back(Path.Vec[J]);
+  }
+  Query.push_back(Path.Sinks[I].second);
+  return Query;
+}
 
-    for (const auto &E : Vec) {
-      Solver.add(E);
+// Searches an input that reaches a sink of Path and stores it. Vec is set to
+// the query that was solved for.
+bool generateCrash(const ExecutedPath &Path, z3::expr_vector &Vec) {
+  for (unsigned I = 0; I < Path.Sinks.size(); I++) {
+    z3::expr_vector Query = sinkQuery(Path, I);
+    if (!markQuery(Query))
+      continue;
+    z3::expr_vector Slice = sliceQuery(Query);
+    ModelTy Model;
+    if (solve(Solver, Cache, Slice, Model) != z3::sat)
+      continue;
+    ModelTy Inputs = Path.Inputs;
+    for (auto &E : Model) {
+      Inputs[E.first] = E.second;
     }
-    z3::check_result Result = Solver.check();
+    storeInput(Inputs);
+    printNewPathCondition(Slice);
+    Vec = Query;
+    return true;
+  }
+  return false;
+}
+
+// Searches the next input from the path Vec of an execution on Inputs. Vec
+// is left as the query that was solved for.
+bool generateInput(z3::expr_vector &Vec, ModelTy Inputs) {
+  while (searchStrategy(Vec)) {
+    // only the inputs the negated branch depends on are solved for, the
+    // others keep their values from the last execution
+    z3::expr_vector Slice = sliceQuery(Vec);
+    ModelTy Model;
+    z3::check_result Result = solve(Solver, Cache, Slice, Model);
     if (Result == z3::sat) {
-      storeInput();
-      printNewPathCondition(Vec);
-      break;
+      for (auto &E : Model) {
+        Inputs[E.first] = E.second;
+      }
+      storeInput(Inputs);
+      printNewPathCondition(Slice);
+      return true;
     }
   }
+  return false;
 }
 
 int main(int argc, char **argv) {
-  if (argc < 2) {
-    std::cerr << "Expected an argument - executable file name" << std::endl;
+  cl::ParseCommandLineOptions(argc, argv,
+                              "Dynamic symbolic execution driver\n");
+
+  struct stat Buffer;
+  if (stat(Program.c_str(), &Buffer)) {
+    std::cerr << Program << " not found\n" << std::endl;
     return 1;
   }
 
-  struct stat Buffer;
-  if (stat(argv[1], &Buffer)) {
-    std::cerr << argv[1] << " not found\n" << std::endl;
+  if (Record && Fork) {
+    std::cerr << "-trace and -fork cannot be combined" << std::endl;
     return 1;
   }
+  // Only i32 values are instrumented, so wider arithmetic would miss the
+  // overflows of the program.
+  if (BitWidth != 0 && BitWidth != 32) {
+    std::cerr << "-bv takes a width of 32" << std::endl;
+    return 1;
+  }
+  setenv("DSE_BRANCH_BUDGET", std::to_string(BranchBudget).c_str(), 1);
+  setenv("DSE_BV_WIDTH", std::to_string(BitWidth).c_str(), 1);
+  setenv("DSE_SIMPLIFY", Simplify ? "1" : "0", 1);
+  if (SolverMemory)
+    z3::set_param("memory_max_size", (int)SolverMemory);
+  Solver = makeSolver(Ctx);
+  if (Record)
+    setenv("DSE_MODE", "record", 1);
+  if (Fork) {
+    setenv("DSE_MODE", "fork", 1);
+    setenv("DSE_MAX_FORKS", std::to_string(MaxForks).c_str(), 1);
+  }
+  if (Hybrid && NumWorkers > 1) {
+    std::cerr << "-fuzz and -j cannot be combined" << std::endl;
+    return 1;
+  }
+  if (NumWorkers > 1) {
+    char Path[PATH_MAX];
+    // the workers run the program from their own directories
+    if (!realpath(Program.c_str(), Path)) {
+      std::cerr << Program << " not found\n" << std::endl;
+      return 1;
+    }
+    return exploreParallel(Path, NumWorkers, MaxIter, Record, Fork) ? 0 : 1;
+  }
 
-  int MaxIter = INT_MAX;
-  if (argc == 3) {
-    MaxIter = atoi(argv[2]);
+  TraceBuffer Trace;
+  if (Record && !Trace.create(TraceFile, DefaultTraceCapacity)) {
+    std::cerr << "Cannot create " << TraceFile << std::endl;
+    return 1;
+  }
+
+  // the fuzzer clears the map after every execution, otherwise it
+  // accumulates the coverage of the campaign
+  CoverageMap Coverage;
+  if (!Coverage.create(CoverageFile)) {
+    std::cerr << "Cannot create " << CoverageFile << std::endl;
+    return 1;
   }
+  setenv("DSE_COVERAGE", CoverageFile, 1);
+  std::unique_ptr<Fuzzer> F;
+  if (Hybrid)
+    F.reset(new Fuzzer(Program, Coverage));
+  // inputs of new coverage found by the fuzzer, executed before any query
+  std::vector<ModelTy> Seeds;
+  bool Fuzzed = false;
 
+  // paths of forked processes, or of executions left for a seed, that are
+  // left to search from
+  std::vector<ExecutedPath> Pending;
   int Iter = 0;
   while (Iter < MaxIter) {
     std::cout << "Iter " << Iter << std::endl;
-    int Ret = std::system(argv[1]);
+    ExecutedPath Path(Ctx);
+    int Ret = Record ? runRecorded(Program, Trace, Path)
+                     : std::system(Program.c_str());
     if (Ret) {
+      Stats.addCrash();
       std::cout << "Crashing input found (" << Iter << " iters)" << std::endl;
       break;
     }
-    if (stat(FormulaFile, &Buffer)) {
-      std::cerr << FormulaFile << " not found" << std::endl;
-      return 1;
+    if (!Record) {
+      if (stat(FormulaFile, &Buffer)) {
+        std::cerr << FormulaFile << " not found" << std::endl;
+        return 1;
+      }
+      if (!readFormula(FormulaFile, Path.Vec, Path.Sinks)) {
+        std::cerr << "Cannot read " << FormulaFile << std::endl;
+        return 1;
+      }
+    }
+    Path.Inputs = loadInput();
+    Stats.addExecution(Path.Vec);
+    if (Fork) {
+      for (auto &F : collectForks(Ctx)) {
+        markExplored(F.Vec);
+        Stats.addExecution(F.Vec);
+        Pending.push_back(F);
+      }
+    }
+    // the fuzzer takes over again whenever the solver found new coverage
+    if (F && (F->update(Path.Inputs) || !Fuzzed)) {
+      Fuzzed = true;
+      if (F->run(Plateau, Seeds)) {
+        Stats.addCrash();
+        std::cout << "Crashing input found by fuzzing (" << Iter
+                  << " iters, " << F->getExecutions() << " fuzzing execs)"
+                  << std::endl;
+        break;
+      }
+      std::cout << "Fuzzing: " << F->getExecutions() << " execs, "
+                << F->getCorpusSize() << " inputs, " << F->getCovered()
+                << " branch sides covered" << std::endl;
     }
-    generateInput();
+    reportStats(F ? F->getCovered() : Coverage.count());
+    // the sinks are tried before any branch is negated, those of the paths
+    // of forked processes as well
+    z3::expr_vector Vec(Ctx);
+    bool Found = generateCrash(Path, Vec);
+    for (unsigned I = Pending.size(); !Found && I-- > 0;) {
+      Found = generateCrash(Pending[I], Vec);
+    }
+    if (!Found && !Seeds.empty()) {
+      // the seed is executed symbolically first, its branches are negated
+      // once no seed is left
+      Pending.push_back(Path);
+      storeInput(Seeds.back());
+      Seeds.pop_back();
+      Found = true;
+    }
+    if (!Found) {
+      Vec = Path.Vec;
+      Found = generateInput(Vec, Path.Inputs);
+    }
+    while (!Found && !Pending.empty()) {
+      Vec = Pending.back().Vec;
+      ModelTy Inputs = Pending.back().Inputs;
+      Pending.pop_back();
+      Found = generateInput(Vec, Inputs);
+    }
+    if (!Found) {
+      std::cout << "All paths explored (" << Iter << " iters)" << std::endl;
+      break;
+    }
+    // the next execution forks only after the negated branch
+    if (Fork)
+      setenv("DSE_FORK_DEPTH", std::to_string(Vec.size()).c_str(), 1);
     Iter++;
   }
+  if (F) {
+    // a crashing execution has not been collected
+    F->update(loadInput());
+    std::cout << "Branch sides covered: " << F->getCovered() << std::endl;
+  }
+  reportStats(F ? F->getCovered() : Coverage.count(), true);
+  Cache.print(std::cout);
 }
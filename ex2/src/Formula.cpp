@@ -0,0 +1,457 @@
+#include "Formula.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+
+static const uint64_t FormulaMagic = 0x46455344; // "DSEF"
+
+static void putVarint(std::string &Out, uint64_t V) {
+  while (V >= 0x80) {
+    Out.push_back((char)(V | 0x80));
+    V >>= 7;
+  }
+  Out.push_back((char)V);
+}
+
+static uint64_t zigzag(int64_t V) { return ((uint64_t)V << 1) ^ (V >> 63); }
+
+static int64_t unzigzag(uint64_t V) {
+  return (int64_t)(V >> 1) ^ -(int64_t)(V & 1);
+}
+
+// Appends the node of E, whose arguments are numbered in Index already.
+static bool encode(const z3::expr &E,
+                   const std::unordered_map<unsigned, uint64_t> &Index,
+                   std::string &Out) {
+  int64_t Val;
+  uint64_t Bits;
+  if (E.is_numeral() && E.is_bv()) {
+    if (E.get_sort().bv_size() > 64 || !E.is_numeral_u64(Bits))
+      return false;
+    putVarint(Out, BVNumeralNode);
+    putVarint(Out, E.get_sort().bv_size());
+    putVarint(Out, Bits);
+    return true;
+  }
+  if (E.is_numeral()) {
+    if (E.is_numeral_i64(Val)) {
+      putVarint(Out, NumeralNode);
+      putVarint(Out, zigzag(Val));
+    } else {
+      std::string Digits = Z3_get_numeral_string(E.ctx(), E);
+      putVarint(Out, BigNumeralNode);
+      putVarint(Out, Digits.size());
+      Out += Digits;
+    }
+    return true;
+  }
+  if (!E.is_app())
+    return false;
+  z3::func_decl Decl = E.decl();
+  z3::expr Arg = E.num_args() == 1 ? E.arg(0) : E;
+  if (Decl.decl_kind() == Z3_OP_SIGN_EXT && Arg.is_const() &&
+      Arg.decl().decl_kind() == Z3_OP_UNINTERPRETED) {
+    // a wide input, see SymbolicInterpreter::makeInput
+    std::string Name = Arg.decl().name().str();
+    if (Arg.get_sort().bv_size() != 32 || Name.size() < 2 || Name[0] != 'X')
+      return false;
+    putVarint(Out, BVInputNode);
+    putVarint(Out, E.get_sort().bv_size());
+    putVarint(Out, std::stoul(Name.substr(1)));
+    return true;
+  }
+  if (Decl.decl_kind() == Z3_OP_UNINTERPRETED) {
+    std::string Name = Decl.name().str();
+    if (E.num_args() != 0 || Name.size() < 2)
+      return false;
+    if (Name[0] == 'B') {
+      // a byte, see SymbolicInterpreter::makeByteInput
+      putVarint(Out, ByteInputNode);
+      putVarint(Out, E.is_bv() ? E.get_sort().bv_size() : 0);
+      putVarint(Out, std::stoul(Name.substr(1)));
+      return true;
+    }
+    if (Name[0] != 'X')
+      return false;
+    if (E.is_bv()) {
+      putVarint(Out, BVInputNode);
+      putVarint(Out, E.get_sort().bv_size());
+    } else {
+      putVarint(Out, InputNode);
+    }
+    putVarint(Out, std::stoul(Name.substr(1)));
+    return true;
+  }
+  putVarint(Out, AppNode);
+  putVarint(Out, Decl.decl_kind());
+  putVarint(Out, E.num_args());
+  for (unsigned I = 0; I < E.num_args(); I++) {
+    putVarint(Out, Index.at(Z3_get_ast_id(E.ctx(), E.arg(I))));
+  }
+  return true;
+}
+
+// Numbers the terms of E and of its subterms that are not numbered yet in
+// post order. Returns the index of E, or -1 for a term without an encoding.
+static int64_t number(const z3::expr &Root,
+                      std::unordered_map<unsigned, uint64_t> &Index,
+                      std::string &Nodes) {
+  // without recursion, as terms built in loops can be very deep
+  std::vector<std::pair<z3::expr, bool>> Stack;
+  Stack.push_back(std::make_pair(Root, false));
+  while (!Stack.empty()) {
+    z3::expr E = Stack.back().first;
+    bool Expanded = Stack.back().second;
+    Stack.pop_back();
+    unsigned ID = Z3_get_ast_id(E.ctx(), E);
+    if (Index.count(ID))
+      continue;
+    if (!Expanded && E.is_app() && E.num_args() > 0) {
+      Stack.push_back(std::make_pair(E, true));
+      for (unsigned I = E.num_args(); I-- > 0;) {
+        Stack.push_back(std::make_pair(E.arg(I), false));
+      }
+      continue;
+    }
+    if (!encode(E, Index, Nodes))
+      return -1;
+    uint64_t Next = Index.size();
+    Index[ID] = Next;
+  }
+  return Index[Z3_get_ast_id(Root.ctx(), Root)];
+}
+
+bool writeFormula(const std::string &FileName,
+                  const std::vector<std::pair<int, z3::expr>> &PathCondition,
+                  const std::vector<std::pair<int, z3::expr>> &Sinks) {
+  std::unordered_map<unsigned, uint64_t> Index;
+  std::string Nodes;
+  std::string Roots;
+  for (auto *List : {&PathCondition, &Sinks}) {
+    putVarint(Roots, List->size());
+    for (auto &E : *List) {
+      int64_t Root = number(E.second, Index, Nodes);
+      if (Root < 0) {
+        // the driver must not read the formula of an earlier execution
+        std::remove(FileName.c_str());
+        return false;
+      }
+      putVarint(Roots, E.first);
+      putVarint(Roots, Root);
+    }
+  }
+
+  std::string Out;
+  putVarint(Out, FormulaMagic);
+  putVarint(Out, Index.size());
+  Out += Nodes;
+  Out += Roots;
+  // written aside and renamed, so that the file is either whole or absent;
+  // the hidden name keeps it out of the scan for fork files
+  size_t Base = FileName.rfind('/') + 1;
+  std::string Temp =
+      FileName.substr(0, Base) + "." + FileName.substr(Base) + ".tmp";
+  std::ofstream OS(Temp, std::ios::binary);
+  OS.write(Out.data(), Out.size());
+  OS.close();
+  if (!OS || std::rename(Temp.c_str(), FileName.c_str())) {
+    std::remove(Temp.c_str());
+    std::remove(FileName.c_str());
+    return false;
+  }
+  return true;
+}
+
+namespace {
+
+class Decoder {
+public:
+  Decoder(const std::string &In, z3::context &Ctx) : In(In), Ctx(Ctx) {}
+
+  uint64_t get() {
+    uint64_t V = 0;
+    for (int Shift = 0; Pos < In.size() && Shift < 64; Shift += 7) {
+      uint8_t B = In[Pos++];
+      V |= (uint64_t)(B & 0x7f) << Shift;
+      if (!(B & 0x80))
+        return V;
+    }
+    Failed = true;
+    return 0;
+  }
+
+  bool decode(z3::expr_vector &Vec,
+              std::vector<std::pair<int, z3::expr>> &Sinks);
+
+private:
+  bool decodeNode(std::vector<z3::expr> &Nodes);
+  bool build(uint64_t Kind, const std::vector<z3::expr> &Args,
+             std::vector<z3::expr> &Nodes);
+
+  const std::string &In;
+  size_t Pos = 0;
+  bool Failed = false;
+  z3::context &Ctx;
+};
+
+bool Decoder::build(uint64_t Kind, const std::vector<z3::expr> &Args,
+                    std::vector<z3::expr> &Nodes) {
+  size_t N = Args.size();
+  auto fold = [&](z3::expr (*Op)(const z3::expr &, const z3::expr &)) {
+    z3::expr E = Args[0];
+    for (size_t I = 1; I < N; I++) {
+      E = Op(E, Args[I]);
+    }
+    return E;
+  };
+  z3::expr_vector Vec(Ctx);
+  for (const z3::expr &A : Args) {
+    Vec.push_back(A);
+  }
+
+  switch (Kind) {
+  case Z3_OP_TRUE:
+    Nodes.push_back(Ctx.bool_val(true));
+    return true;
+  case Z3_OP_FALSE:
+    Nodes.push_back(Ctx.bool_val(false));
+    return true;
+  case Z3_OP_AND:
+    Nodes.push_back(z3::mk_and(Vec));
+    return true;
+  case Z3_OP_OR:
+    Nodes.push_back(z3::mk_or(Vec));
+    return true;
+  case Z3_OP_DISTINCT:
+    if (N < 2)
+      return false;
+    Nodes.push_back(z3::distinct(Vec));
+    return true;
+  default:
+    break;
+  }
+
+  if (N == 1) {
+    switch (Kind) {
+    case Z3_OP_NOT:
+      Nodes.push_back(!Args[0]);
+      return true;
+    case Z3_OP_UMINUS:
+    case Z3_OP_BNEG:
+      Nodes.push_back(-Args[0]);
+      return true;
+    case Z3_OP_BNOT:
+      Nodes.push_back(~Args[0]);
+      return true;
+    default:
+      return false;
+    }
+  }
+  if (N == 3 && Kind == Z3_OP_ITE) {
+    Nodes.push_back(z3::ite(Args[0], Args[1], Args[2]));
+    return true;
+  }
+  if (N < 2)
+    return false;
+  switch (Kind) {
+  case Z3_OP_ADD:
+  case Z3_OP_BADD:
+    Nodes.push_back(fold(z3::operator+));
+    return true;
+  case Z3_OP_SUB:
+  case Z3_OP_BSUB:
+    Nodes.push_back(fold(z3::operator-));
+    return true;
+  case Z3_OP_MUL:
+  case Z3_OP_BMUL:
+    Nodes.push_back(fold(z3::operator*));
+    return true;
+  case Z3_OP_BAND:
+    Nodes.push_back(fold(z3::operator&));
+    return true;
+  case Z3_OP_BOR:
+    Nodes.push_back(fold(z3::operator|));
+    return true;
+  case Z3_OP_BXOR:
+    Nodes.push_back(fold(z3::operator^));
+    return true;
+  default:
+    break;
+  }
+  if (N != 2)
+    return false;
+  const z3::expr &L = Args[0];
+  const z3::expr &R = Args[1];
+  switch (Kind) {
+  case Z3_OP_EQ:
+    Nodes.push_back(L == R);
+    return true;
+  case Z3_OP_IMPLIES:
+    Nodes.push_back(z3::implies(L, R));
+    return true;
+  case Z3_OP_LE:
+  case Z3_OP_SLEQ:
+    Nodes.push_back(L <= R);
+    return true;
+  case Z3_OP_GE:
+  case Z3_OP_SGEQ:
+    Nodes.push_back(L >= R);
+    return true;
+  case Z3_OP_LT:
+  case Z3_OP_SLT:
+    Nodes.push_back(L < R);
+    return true;
+  case Z3_OP_GT:
+  case Z3_OP_SGT:
+    Nodes.push_back(L > R);
+    return true;
+  case Z3_OP_ULEQ:
+    Nodes.push_back(z3::ule(L, R));
+    return true;
+  case Z3_OP_UGEQ:
+    Nodes.push_back(z3::uge(L, R));
+    return true;
+  case Z3_OP_ULT:
+    Nodes.push_back(z3::ult(L, R));
+    return true;
+  case Z3_OP_UGT:
+    Nodes.push_back(z3::ugt(L, R));
+    return true;
+  case Z3_OP_IDIV:
+  case Z3_OP_BSDIV:
+    Nodes.push_back(L / R);
+    return true;
+  case Z3_OP_BUDIV:
+    Nodes.push_back(z3::udiv(L, R));
+    return true;
+  case Z3_OP_BSREM:
+    Nodes.push_back(z3::srem(L, R));
+    return true;
+  case Z3_OP_BUREM:
+    Nodes.push_back(z3::urem(L, R));
+    return true;
+  case Z3_OP_BSHL:
+    Nodes.push_back(z3::shl(L, R));
+    return true;
+  case Z3_OP_BLSHR:
+    Nodes.push_back(z3::lshr(L, R));
+    return true;
+  case Z3_OP_BASHR:
+    Nodes.push_back(z3::ashr(L, R));
+    return true;
+  case Z3_OP_REM:
+    Nodes.push_back(z3::rem(L, R));
+    return true;
+  case Z3_OP_MOD:
+    Nodes.push_back(z3::mod(L, R));
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool Decoder::decodeNode(std::vector<z3::expr> &Nodes) {
+  switch (get()) {
+  case InputNode:
+    Nodes.push_back(Ctx.int_const(("X" + std::to_string(get())).c_str()));
+    return !Failed;
+  case NumeralNode:
+    Nodes.push_back(Ctx.int_val((int64_t)unzigzag(get())));
+    return !Failed;
+  case BigNumeralNode: {
+    uint64_t Size = get();
+    if (Failed || Size > In.size() - Pos)
+      return false;
+    std::string Digits = In.substr(Pos, Size);
+    Pos += Size;
+    Nodes.push_back(Ctx.int_val(Digits.c_str()));
+    return true;
+  }
+  case BVInputNode: {
+    unsigned Width = get();
+    std::string Name = "X" + std::to_string(get());
+    if (Failed || Width < 32 || Width > 64)
+      return false;
+    z3::expr Input = Ctx.bv_const(Name.c_str(), 32);
+    Nodes.push_back(Width > 32 ? z3::sext(Input, Width - 32) : Input);
+    return true;
+  }
+  case ByteInputNode: {
+    unsigned Width = get();
+    std::string Name = "B" + std::to_string(get());
+    if (Failed || Width > 64)
+      return false;
+    Nodes.push_back(Width ? Ctx.bv_const(Name.c_str(), Width)
+                          : Ctx.int_const(Name.c_str()));
+    return true;
+  }
+  case BVNumeralNode: {
+    unsigned Width = get();
+    uint64_t Bits = get();
+    if (Failed || Width == 0 || Width > 64)
+      return false;
+    Nodes.push_back(Ctx.bv_val(Bits, Width));
+    return true;
+  }
+  case AppNode: {
+    uint64_t Kind = get();
+    uint64_t Arity = get();
+    std::vector<z3::expr> Args;
+    for (uint64_t I = 0; I < Arity && !Failed; I++) {
+      uint64_t Arg = get();
+      // arguments precede their users
+      if (Arg >= Nodes.size())
+        return false;
+      Args.push_back(Nodes[Arg]);
+    }
+    return !Failed && build(Kind, Args, Nodes);
+  }
+  default:
+    return false;
+  }
+}
+
+bool Decoder::decode(z3::expr_vector &Vec,
+                     std::vector<std::pair<int, z3::expr>> &Sinks) {
+  if (get() != FormulaMagic)
+    return false;
+  uint64_t NumNodes = get();
+  std::vector<z3::expr> Nodes;
+  for (uint64_t I = 0; I < NumNodes; I++) {
+    if (!decodeNode(Nodes))
+      return false;
+  }
+  uint64_t NumRoots = get();
+  for (uint64_t I = 0; I < NumRoots && !Failed; I++) {
+    get(); // the branch ID
+    uint64_t Root = get();
+    if (Root >= Nodes.size())
+      return false;
+    Vec.push_back(Nodes[Root]);
+  }
+  uint64_t NumSinks = get();
+  for (uint64_t I = 0; I < NumSinks && !Failed; I++) {
+    int Prefix = get();
+    uint64_t Root = get();
+    if (Root >= Nodes.size())
+      return false;
+    Sinks.push_back(std::make_pair(Prefix, Nodes[Root]));
+  }
+  return !Failed;
+}
+
+} // namespace
+
+bool readFormula(const std::string &FileName, z3::expr_vector &Vec,
+                 std::vector<std::pair<int, z3::expr>> &Sinks) {
+  std::ifstream IS(FileName, std::ios::binary);
+  if (!IS)
+    return false;
+  std::string In((std::istreambuf_iterator<char>(IS)),
+                 std::istreambuf_iterator<char>());
+  Decoder D(In, Vec.ctx());
+  return D.decode(Vec, Sinks);
+}
@@ -0,0 +1,93 @@
+#include "Fuzzer.h"
+
+#include <climits>
+#include <cstdlib>
+#include <iterator>
+
+#include "DSE.h"
+
+// values that often sit on the boundary of a branch
+static const int Interesting[] = {0, 1, -1, 2, 16, 32, 64, 100, 127, 128,
+                                  255, 256, 512, 1000, 1024, 4096, 32767,
+                                  65535, -128, -129, -256, 32768, INT_MAX,
+                                  INT_MIN};
+
+Fuzzer::Fuzzer(const std::string &Program, CoverageMap &Coverage)
+    : Command("DSE_MODE=fuzz " + Program), Coverage(Coverage),
+      Seen(CoverageMap::Size), Rand(std::random_device()()) {}
+
+bool Fuzzer::update(const ModelTy &Input) {
+  const uint8_t *Bits = Coverage.getBits();
+  bool New = false;
+  for (size_t I = 0; I < CoverageMap::Size; I++) {
+    if (Bits[I] && !Seen[I]) {
+      Seen[I] = 1;
+      Covered++;
+      New = true;
+    }
+  }
+  Coverage.reset();
+  // the first input seeds the corpus even without branches
+  if (New || Corpus.empty())
+    Corpus.push_back(Input);
+  return New;
+}
+
+ModelTy Fuzzer::mutate(const ModelTy &Input) {
+  ModelTy Mutant = Input;
+  if (Mutant.empty())
+    return Mutant;
+  // stack a few mutations
+  int Count = 1 + Rand() % 4;
+  for (int I = 0; I < Count; I++) {
+    auto It = Mutant.begin();
+    std::advance(It, Rand() % Mutant.size());
+    uint32_t V = It->second;
+    switch (Rand() % 6) {
+    case 0:
+      V ^= 1u << (Rand() % 32);
+      break;
+    case 1:
+      V += 1 + Rand() % 35;
+      break;
+    case 2:
+      V -= 1 + Rand() % 35;
+      break;
+    case 3:
+      V = Interesting[Rand() % (sizeof(Interesting) / sizeof(int))];
+      break;
+    case 4:
+      V = Rand();
+      break;
+    default: {
+      // splice in the value of an input of another corpus entry
+      const ModelTy &Other = Corpus[Rand() % Corpus.size()];
+      auto From = Other.begin();
+      if (Other.empty())
+        break;
+      std::advance(From, Rand() % Other.size());
+      V = From->second;
+      break;
+    }
+    }
+    It->second = (int)V;
+  }
+  return Mutant;
+}
+
+bool Fuzzer::run(int Plateau, std::vector<ModelTy> &Seeds) {
+  for (int Stale = 0; Stale < Plateau; Stale++) {
+    storeInput(mutate(Corpus[Rand() % Corpus.size()]));
+    Executions++;
+    Stats.addFuzzExecution();
+    if (std::system(Command.c_str()))
+      return true;
+    ModelTy Input = loadInput();
+    if (update(Input)) {
+      Seeds.push_back(Input);
+      Stale = -1;
+    }
+    reportStats(Covered);
+  }
+  return false;
+}
@@ -0,0 +1,62 @@
+#include "Independence.h"
+
+#include <vector>
+
+static void collectInputs(const z3::expr &E, std::set<std::string> &Inputs,
+                          std::set<unsigned> &Visited) {
+  if (!Visited.insert(Z3_get_ast_id(E.ctx(), E)).second)
+    return;
+  if (E.is_const() && E.decl().decl_kind() == Z3_OP_UNINTERPRETED) {
+    Inputs.insert(E.decl().name().str());
+    return;
+  }
+  if (E.is_app()) {
+    for (unsigned I = 0; I < E.num_args(); I++) {
+      collectInputs(E.arg(I), Inputs, Visited);
+    }
+  }
+}
+
+void collectInputs(const z3::expr &E, std::set<std::string> &Inputs) {
+  std::set<unsigned> Visited;
+  collectInputs(E, Inputs, Visited);
+}
+
+z3::expr_vector sliceQuery(const z3::expr_vector &Query) {
+  z3::expr_vector Slice(Query.ctx());
+  if (Query.empty())
+    return Slice;
+
+  std::vector<std::set<std::string>> Vars(Query.size());
+  for (unsigned I = 0; I < Query.size(); I++) {
+    collectInputs(Query[I], Vars[I]);
+  }
+
+  // grow the set of relevant inputs from the negated branch until no other
+  // constraint shares an input with it
+  std::vector<bool> InSlice(Query.size(), false);
+  std::set<std::string> Relevant = Vars.back();
+  InSlice.back() = true;
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (unsigned I = 0; I < Query.size(); I++) {
+      if (InSlice[I])
+        continue;
+      for (auto &V : Vars[I]) {
+        if (Relevant.count(V)) {
+          InSlice[I] = true;
+          Relevant.insert(Vars[I].begin(), Vars[I].end());
+          Changed = true;
+          break;
+        }
+      }
+    }
+  }
+
+  for (unsigned I = 0; I < Query.size(); I++) {
+    if (InSlice[I])
+      Slice.push_back(Query[I]);
+  }
+  return Slice;
+}
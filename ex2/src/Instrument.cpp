@@ -1,141 +1,607 @@
 #include "Instrument.h"
 
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
 using namespace llvm;
 
 namespace instrument {
 
+static cl::opt<std::string>
+    MapFile("dse-map",
+            cl::desc("File mapping DSE register and branch IDs to the source, "
+                     "read by the runtime as <binary>.dsemap; all modules of "
+                     "a program must share one map so that their IDs do not "
+                     "collide (default: <source file stem>.dsemap)"),
+            cl::value_desc("filename"));
+
+Function *getHook(Module &M, const char *Name, FunctionType *FT) {
+  Function *F = M.getFunction(Name);
+  if (!F) {
+    F = Function::Create(FT, Function::ExternalLinkage, Name, &M);
+    F->setDSOLocal(true);
+  }
+  return F;
+}
+
 // declare DSE instrument functions
-void declare(Module *M, LLVMContext &C, IRBuilder<> Builder) {
+void Instrument::declare(Module &M) {
+  LLVMContext &C = M.getContext();
+  Type *VoidTy = Type::getVoidTy(C);
+  Type *Int32Ty = Type::getInt32Ty(C);
+  Type *Int32PtrTy = Type::getInt32PtrTy(C);
+  Type *Int8PtrTy = Type::getInt8PtrTy(C);
+  auto IntsFT = [&](int N) {
+    return FunctionType::get(VoidTy, std::vector<Type *>(N, Int32Ty), false);
+  };
+
   // declare void __DSE_Init__()
-  FunctionType *DSEInitFT = FunctionType::get(Type::getVoidTy(C), false);
-  Function *DSEInitFunction = Function::Create(
-      DSEInitFT, Function::ExternalLinkage, DSEInitFunctionName, M);
-  DSEInitFunction->setDSOLocal(true);
-
-  // declare void __DSE_Branch__(int R, int *Ptr)
-  FunctionType *DSEBranchFT = FunctionType::get(
-      Type::getVoidTy(C),
-      {Type::getInt32Ty(C), Type::getInt32Ty(C), Type::getInt32Ty(C)}, false);
-  Function *DSEBranchFuntion = Function::Create(
-      DSEBranchFT, Function::ExternalLinkage, DSEBranchFunctionName, M);
-  DSEBranchFuntion->setDSOLocal(true);
-
-  // declare void __DSE_Const__(int X)
-  FunctionType *DSEConstFT =
-      FunctionType::get(Type::getVoidTy(C), Type::getInt32Ty(C), false);
-  Function *DSEConstFuntion = Function::Create(
-      DSEConstFT, Function::ExternalLinkage, DSEConstFunctionName, M);
-  DSEConstFuntion->setDSOLocal(true);
-
-  // declare void _DSE_Register_(int X)
-  FunctionType *DSERegisterFT =
-      FunctionType::get(Type::getVoidTy(C), Type::getInt32Ty(C), false);
-  Function *DSERegisterFuntion = Function::Create(
-      DSERegisterFT, Function::ExternalLinkage, DSERegisterFunctionName, M);
-  DSERegisterFuntion->setDSOLocal(true);
+  DSEInitFunction =
+      getHook(M, DSEInitFunctionName, FunctionType::get(VoidTy, false));
+
+  // declare void __DSE_Module__(char *Source)
+  DSEModuleFunction =
+      getHook(M, DSEModuleFunctionName,
+              FunctionType::get(VoidTy, {Int8PtrTy}, false));
 
   // declare void __DSE_Alloca__(int R, int *Ptr)
-  FunctionType *DSEAllocaFT = FunctionType::get(
-      Type::getVoidTy(C), {Type::getInt32Ty(C), Type::getInt32PtrTy(C)}, false);
-  Function *DSEAllocaFuntion = Function::Create(
-      DSEAllocaFT, Function::ExternalLinkage, DSEAllocaFunctionName, M);
-  DSEAllocaFuntion->setDSOLocal(true);
-
-  // declare void __DSE_Store__(int X)
-  FunctionType *DSEStoreFT =
-      FunctionType::get(Type::getVoidTy(C), Type::getInt32Ty(C), false);
-  Function *DSEStoreFuntion = Function::Create(
-      DSEStoreFT, Function::ExternalLinkage, DSEStoreFunctionName, M);
-  DSEStoreFuntion->setDSOLocal(true);
+  DSEAllocaFunction =
+      getHook(M, DSEAllocaFunctionName,
+              FunctionType::get(VoidTy, {Int32Ty, Int32PtrTy}, false));
+
+  // declare void __DSE_Store__(int *X, int ID, int Val)
+  DSEStoreFunction = getHook(
+      M, DSEStoreFunctionName,
+      FunctionType::get(VoidTy, {Int32PtrTy, Int32Ty, Int32Ty}, false));
 
   // declare void __DSE_Load__(int Y, int *X)
-  FunctionType *DSELoadFT = FunctionType::get(
-      Type::getVoidTy(C), {Type::getInt32Ty(C), Type::getInt32PtrTy(C)}, false);
-  Function *DSELoadFuntion = Function::Create(
-      DSELoadFT, Function::ExternalLinkage, DSELoadFunctionName, M);
-  DSELoadFuntion->setDSOLocal(true);
-
-  // declare void __DSE_ICmp__(int R, int Op)
-  FunctionType *DSEICmpFT = FunctionType::get(
-      Type::getVoidTy(C), {Type::getInt32Ty(C), Type::getInt32Ty(C)}, false);
-  Function *DSEICmpFuntion = Function::Create(
-      DSEICmpFT, Function::ExternalLinkage, DSEICmpFunctionName, M);
-  DSEICmpFuntion->setDSOLocal(true);
-
-  // declare void __DSE_BinOp__(int R, int Op)
-  FunctionType *DSEBinOpFT = FunctionType::get(
-      Type::getVoidTy(C), {Type::getInt32Ty(C), Type::getInt32Ty(C)}, false);
-  Function *DSEBinOpFuntion = Function::Create(
-      DSEBinOpFT, Function::ExternalLinkage, DSEBinOpFunctionName, M);
-  DSEBinOpFuntion->setDSOLocal(true);
-}
-
-void push(Value *V, Module *M, LLVMContext &C, IRBuilder<> Builder) {
-  // push constant
-  if (ConstantInt *CI = dyn_cast<ConstantInt>(V))
-    Builder.CreateCall(M->getFunction(DSEConstFunctionName), V);
-  // push register
-  else
-    Builder.CreateCall(M->getFunction(DSERegisterFunctionName),
-                       ConstantInt::get(Type::getInt32Ty(C), getRegisterID(V)));
+  DSELoadFunction =
+      getHook(M, DSELoadFunctionName,
+              FunctionType::get(VoidTy, {Int32Ty, Int32PtrTy}, false));
+
+  // declare void __DSE_StoreByte__(char *X, int ID, int Val)
+  DSEStoreByteFunction = getHook(
+      M, DSEStoreByteFunctionName,
+      FunctionType::get(VoidTy, {Int8PtrTy, Int32Ty, Int32Ty}, false));
+
+  // declare void __DSE_LoadByte__(int Y, char *X)
+  DSELoadByteFunction =
+      getHook(M, DSELoadByteFunctionName,
+              FunctionType::get(VoidTy, {Int32Ty, Int8PtrTy}, false));
+
+  // declare int __DSE_ICmp__(int R, int B, int Op, int LID, int LVal,
+  //                          int RID, int RVal)
+  DSEICmpFunction =
+      getHook(M, DSEICmpFunctionName,
+              FunctionType::get(Int32Ty, std::vector<Type *>(7, Int32Ty),
+                                false));
+
+  // declare void __DSE_BinOp__(int R, int Op, int LID, int LVal, int RID,
+  //                            int RVal)
+  DSEBinOpFunction = getHook(M, DSEBinOpFunctionName, IntsFT(6));
+
+  // declare void __DSE_Phi__(int R, int ID, int Val, int Last)
+  DSEPhiFunction = getHook(M, DSEPhiFunctionName, IntsFT(4));
+
+  // declare void __DSE_Select__(int R, int CID, int CVal, int TID, int TVal,
+  //                             int FID, int FVal)
+  DSESelectFunction = getHook(M, DSESelectFunctionName, IntsFT(7));
+
+  // declare void __DSE_Cast__(int R, int Op, int Width, int ID, int Val)
+  DSECastFunction = getHook(M, DSECastFunctionName, IntsFT(5));
+
+  // declare void __DSE_Arg__(int I, int ID, int Val)
+  DSEArgFunction = getHook(M, DSEArgFunctionName, IntsFT(3));
+
+  // declare void __DSE_Param__(int R, int I, int Val)
+  DSEParamFunction = getHook(M, DSEParamFunctionName, IntsFT(3));
+
+  // declare void __DSE_Return__(int ID, int Val)
+  DSEReturnFunction = getHook(M, DSEReturnFunctionName, IntsFT(2));
+
+  // declare void __DSE_CallResult__(int R, int Val)
+  DSECallResultFunction = getHook(M, DSECallResultFunctionName, IntsFT(2));
+
+  // declare void __DSE_Enter__(int First, int Count)
+  DSEEnterFunction = getHook(M, DSEEnterFunctionName, IntsFT(2));
+
+  // declare void __DSE_Leave__()
+  DSELeaveFunction =
+      getHook(M, DSELeaveFunctionName, FunctionType::get(VoidTy, false));
+}
+
+int IDTable::getID(Value *V) {
+  auto It = IDs.find(V);
+  if (It != IDs.end())
+    return It->second;
+  int ID = First + Values.size();
+  IDs[V] = ID;
+  Values.push_back(V);
+  return ID;
+}
+
+// the instrumented function called by I, if any
+Function *getInstrumentedCallee(Instruction *I) {
+  if (CallInst *CI = dyn_cast<CallInst>(I)) {
+    Function *Callee = CI->getCalledFunction();
+    if (Callee && !Callee->isDeclaration())
+      return Callee;
+  }
+  return nullptr;
+}
+
+bool isInputCall(Instruction *I) {
+  if (CallInst *CI = dyn_cast<CallInst>(I)) {
+    Function *Callee = CI->getCalledFunction();
+    return Callee && (Callee->getName() == DSEInputFunctionName ||
+                      Callee->getName() == DSEInputBufferFunctionName);
+  }
+  return false;
+}
+
+Value *InputDependence::getObject(Value *Ptr) const {
+  while (true) {
+    Ptr = Ptr->stripPointerCasts();
+    if (GEPOperator *GEP = dyn_cast<GEPOperator>(Ptr))
+      Ptr = GEP->getPointerOperand();
+    else
+      break;
+  }
+  if (isa<AllocaInst>(Ptr) && !Escaped.count(Ptr))
+    return Ptr;
+  return nullptr;
+}
+
+bool InputDependence::mayHoldSymbolic(Value *Ptr) const {
+  Value *Object = getObject(Ptr);
+  return Object ? Objects.count(Object) : UnknownMemory;
+}
+
+// whether the address computed by V is only used to access memory
+bool isOnlyAccessed(Value *V) {
+  for (User *U : V->users()) {
+    if (isa<LoadInst>(U)) {
+      continue;
+    } else if (StoreInst *SI = dyn_cast<StoreInst>(U)) {
+      if (SI->getValueOperand() == V)
+        return false;
+    } else if (isa<BitCastInst>(U) || isa<GetElementPtrInst>(U)) {
+      if (!isOnlyAccessed(U))
+        return false;
+    } else if (!isInputCall(cast<Instruction>(U))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// propagates the dependence through the data flow and memory of F, returns
+// whether anything changed
+bool InputDependence::propagate(Function &F) {
+  bool Changed = false;
+  for (Instruction &I : instructions(F)) {
+    if (isInputCall(&I)) {
+      Value *Object = getObject(cast<CallInst>(&I)->getArgOperand(0));
+      if (Object)
+        Changed |= Objects.insert(Object).second;
+      else if (!UnknownMemory)
+        Changed = UnknownMemory = true;
+    } else if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+      if (mayHoldSymbolic(LI->getPointerOperand()))
+        Changed |= Values.insert(LI).second;
+    } else if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+      if (!isSymbolic(SI->getValueOperand()))
+        continue;
+      Value *Object = getObject(SI->getPointerOperand());
+      if (Object)
+        Changed |= Objects.insert(Object).second;
+      else if (!UnknownMemory)
+        Changed = UnknownMemory = true;
+    } else if (Function *Callee = getInstrumentedCallee(&I)) {
+      // symbolic values flow through the parameters and the return value
+      CallInst *CI = cast<CallInst>(&I);
+      auto Param = Callee->arg_begin();
+      for (auto Arg = CI->arg_begin();
+           Arg != CI->arg_end() && Param != Callee->arg_end(); Arg++, Param++) {
+        if (isSymbolic(*Arg))
+          Changed |= Values.insert(&*Param).second;
+      }
+      if (Returns.count(Callee))
+        Changed |= Values.insert(CI).second;
+    } else if (ReturnInst *RI = dyn_cast<ReturnInst>(&I)) {
+      if (RI->getReturnValue() && isSymbolic(RI->getReturnValue()))
+        Changed |= Returns.insert(&F).second;
+    } else if (isa<BinaryOperator>(&I) || isa<CmpInst>(&I) ||
+               isa<CastInst>(&I) || isa<SelectInst>(&I) || isa<PHINode>(&I)) {
+      for (Value *Op : I.operands()) {
+        if (isSymbolic(Op)) {
+          Changed |= Values.insert(&I).second;
+          break;
+        }
+      }
+    }
+  }
+  return Changed;
+}
+
+void InputDependence::analyze(Module &M) {
+  for (Function &F : M) {
+    for (Instruction &I : instructions(F)) {
+      if (isa<AllocaInst>(&I) && !isOnlyAccessed(&I))
+        Escaped.insert(&I);
+    }
+  }
+  // a symbolic store through an untracked pointer in one function affects
+  // the loads of all others, so iterate over the whole module
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (Function &F : M) {
+      Changed |= propagate(F);
+    }
+  }
+}
+
+// appends the register ID (-1 for concrete operands) and the concrete value of
+// the operand V
+void Instrument::addOperand(Value *V, IRBuilder<> &Builder,
+                            std::vector<Value *> &Args) {
+  Type *Int32Ty = Type::getInt32Ty(V->getContext());
+  int ID = DA.isSymbolic(V) ? Registers.getID(V) : -1;
+  Args.push_back(ConstantInt::get(Int32Ty, ID));
+  Args.push_back(Builder.CreateZExtOrTrunc(V, Int32Ty));
+}
+
+bool isSupported(Value *V) {
+  return V->getType()->isIntegerTy(32) || V->getType()->isIntegerTy(8) ||
+         V->getType()->isIntegerTy(1);
+}
+
+// bytes are loaded and stored as values of their own, see DSE_InputBuffer
+bool isMemoryType(Type *T) { return T->isIntegerTy(32) || T->isIntegerTy(8); }
+
+// whether the comparison I decides a branch, as opposed to only being used as
+// data by selects and casts; a select of i1 combines conditions, e.g.
+// simplifycfg lowers a && b to select a, b, false
+bool isBranchCondition(Instruction *I) {
+  for (User *U : I->users()) {
+    SelectInst *SE = dyn_cast<SelectInst>(U);
+    if (SE && SE->getType()->isIntegerTy(1) && isBranchCondition(SE))
+      return true;
+    if (!SE && !isa<CastInst>(U))
+      return true;
+  }
+  return false;
+}
+
+// A PHI copies the register of the incoming value of the predecessor taken,
+// so a shadow PHI selects the register ID to copy from. The runtime commits
+// the copies of a block at once, on the last PHI.
+void Instrument::instrumentPhis(BasicBlock &B) {
+  LLVMContext &C = B.getContext();
+  Type *Int32Ty = Type::getInt32Ty(C);
+  std::vector<PHINode *> Phis;
+  for (PHINode &Phi : B.phis()) {
+    if (Phi.getType()->isIntegerTy(32) && DA.isSymbolic(&Phi))
+      Phis.push_back(&Phi);
+  }
+
+  std::vector<PHINode *> IDPhis;
+  for (PHINode *Phi : Phis) {
+    PHINode *IDPhi =
+        PHINode::Create(Int32Ty, Phi->getNumIncomingValues(),
+                        Phi->getName() + ".dse", B.getFirstNonPHI());
+    for (unsigned I = 0; I < Phi->getNumIncomingValues(); I++) {
+      Value *V = Phi->getIncomingValue(I);
+      int ID = DA.isSymbolic(V) ? Registers.getID(V) : -1;
+      IDPhi->addIncoming(ConstantInt::get(Int32Ty, ID),
+                         Phi->getIncomingBlock(I));
+    }
+    IDPhis.push_back(IDPhi);
+  }
+
+  IRBuilder<> Builder(&*B.getFirstInsertionPt());
+  for (unsigned I = 0; I < Phis.size(); I++) {
+    Builder.CreateCall(DSEPhiFunction,
+                       {ConstantInt::get(Int32Ty, Registers.getID(Phis[I])),
+                        IDPhis[I], Phis[I],
+                        ConstantInt::get(Int32Ty, I + 1 == Phis.size())});
+  }
+}
+
+// Symbolic arguments and return values are passed through slots of the
+// runtime, which the callee copies into its parameter registers on entry.
+void Instrument::instrumentCall(CallInst *CI) {
+  Function *Callee = getInstrumentedCallee(CI);
+  if (!Callee)
+    return;
+  LLVMContext &C = CI->getContext();
+  Type *Int32Ty = Type::getInt32Ty(C);
+  IRBuilder<> Builder(CI);
+  for (Argument &Param : Callee->args()) {
+    unsigned I = Param.getArgNo();
+    if (I >= (unsigned)(CI->arg_end() - CI->arg_begin()) ||
+        !Param.getType()->isIntegerTy(32) || !DA.isSymbolic(&Param))
+      continue;
+    std::vector<Value *> Args = {ConstantInt::get(Int32Ty, I)};
+    addOperand(CI->getArgOperand(I), Builder, Args);
+    Builder.CreateCall(DSEArgFunction, Args);
+  }
+  if (CI->getType()->isIntegerTy(32) && DA.isSymbolic(CI)) {
+    Builder.SetInsertPoint(CI->getNextNode());
+    Builder.CreateCall(DSECallResultFunction,
+                       {ConstantInt::get(Int32Ty, Registers.getID(CI)), CI});
+  }
 }
 
 /*
  * Implement your instrumentation for dynamic symbolic execution engine
  */
-bool Instrument::runOnFunction(Function &F) {
-  /* Add your code here */
-  Module *M = F.getParent();
-  LLVMContext &C = M->getContext();
-  IRBuilder<> Builder(C);
-  declare(M, C, Builder);
+void Instrument::instrument(Function &F) {
+  LLVMContext &C = F.getContext();
+  Type *Int32Ty = Type::getInt32Ty(C);
+  // the registers of F are numbered consecutively from here
+  int FirstRegister = Registers.First + Registers.Values.size();
+
+  // copy symbolic arguments into the parameter registers
+  IRBuilder<> Entry(&*F.getEntryBlock().getFirstInsertionPt());
+  for (Argument &A : F.args()) {
+    if (A.getType()->isIntegerTy(32) && DA.isSymbolic(&A))
+      Entry.CreateCall(DSEParamFunction,
+                       {ConstantInt::get(Int32Ty, Registers.getID(&A)),
+                        ConstantInt::get(Int32Ty, A.getArgNo()), &A});
+  }
 
   // insert call to __DSE_Init__()
-  Builder.SetInsertPoint(F.getEntryBlock().getFirstNonPHI());
-  Builder.CreateCall(M->getFunction(DSEInitFunctionName));
+  Instruction *Init = nullptr;
+  if (F.getName() == "main") {
+    IRBuilder<> Builder(&*F.getEntryBlock().getFirstInsertionPt());
+    Init = Builder.CreateCall(DSEInitFunction);
+  }
+
+  // the comparisons and the outcomes the runtime returned for them
+  std::vector<std::pair<ICmpInst *, Value *>> Outcomes;
+  std::vector<ReturnInst *> Returns;
 
-  // instrument DSE code on instruction level
+  // instrument DSE code on instruction level, skipping every instruction that
+  // can only compute concrete values
   for (BasicBlock &B : F) {
+    instrumentPhis(B);
     for (Instruction &I : B) {
       IRBuilder<> Builder(&I);
       if (AllocaInst *AI = dyn_cast<AllocaInst>(&I)) {
+        if (!DA.mayHoldSymbolic(AI))
+          continue;
         Builder.SetInsertPoint(AI->getNextNode());
         Builder.CreateCall(
-            M->getFunction(DSEAllocaFunctionName),
-            {ConstantInt::get(Type::getInt32Ty(C), getRegisterID(AI)), AI});
+            DSEAllocaFunction,
+            {ConstantInt::get(Int32Ty, Registers.getID(AI)),
+             Builder.CreatePointerCast(AI, Type::getInt32PtrTy(C))});
       } else if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+        // concrete stores into symbolic memory still clear the shadow value
         Value *From = SI->getValueOperand();
         Value *To = SI->getPointerOperand();
+        if (!isMemoryType(From->getType()) || !DA.mayHoldSymbolic(To))
+          continue;
+        bool Byte = From->getType()->isIntegerTy(8);
         Builder.SetInsertPoint(SI->getNextNode());
-        push(From, M, C, Builder);
-        Builder.CreateCall(
-            M->getFunction(DSEStoreFunctionName),
-            ConstantInt::get(Type::getInt32Ty(C), getRegisterID(To)));
+        std::vector<Value *> Args = {Builder.CreatePointerCast(
+            To, Byte ? Type::getInt8PtrTy(C) : Type::getInt32PtrTy(C))};
+        addOperand(From, Builder, Args);
+        Builder.CreateCall(Byte ? DSEStoreByteFunction : DSEStoreFunction,
+                           Args);
       } else if (LoadInst *LI = dyn_cast<LoadInst>(&I)) {
+        if (!isMemoryType(LI->getType()) || !DA.isSymbolic(LI))
+          continue;
         Value *From = LI->getPointerOperand();
         Builder.SetInsertPoint(LI->getNextNode());
-        Builder.CreateCall(
-            M->getFunction(DSELoadFunctionName),
-            {ConstantInt::get(Type::getInt32Ty(C), getRegisterID(LI)), From});
+        Builder.CreateCall(LI->getType()->isIntegerTy(8) ? DSELoadByteFunction
+                                                         : DSELoadFunction,
+                           {ConstantInt::get(Int32Ty, Registers.getID(LI)),
+                            From});
       } else if (BinaryOperator *BO = dyn_cast<BinaryOperator>(&I)) {
+        if (!BO->getType()->isIntegerTy(32) || !DA.isSymbolic(BO))
+          continue;
         Builder.SetInsertPoint(BO->getNextNode());
-        push(BO->getOperand(0), M, C, Builder);
-        push(BO->getOperand(1), M, C, Builder);
-        Builder.CreateCall(
-            M->getFunction(DSEBinOpFunctionName),
-            {ConstantInt::get(Type::getInt32Ty(C), getRegisterID(BO)),
-             ConstantInt::get(Type::getInt32Ty(C), BO->getOpcode())});
+        std::vector<Value *> Args = {
+            ConstantInt::get(Int32Ty, Registers.getID(BO)),
+            ConstantInt::get(Int32Ty, BO->getOpcode())};
+        addOperand(BO->getOperand(0), Builder, Args);
+        addOperand(BO->getOperand(1), Builder, Args);
+        Builder.CreateCall(DSEBinOpFunction, Args);
       } else if (ICmpInst *IC = dyn_cast<ICmpInst>(&I)) {
+        if (!IC->getOperand(0)->getType()->isIntegerTy(32) ||
+            !DA.isSymbolic(IC))
+          continue;
+        int BID = isBranchCondition(IC) ? Branches.getID(IC) : -1;
         Builder.SetInsertPoint(IC->getNextNode());
-        push(IC->getOperand(0), M, C, Builder);
-        push(IC->getOperand(1), M, C, Builder);
-        Builder.CreateCall(
-            M->getFunction(DSEICmpFunctionName),
-            {ConstantInt::get(Type::getInt32Ty(C), getBranchID(IC)),
-             ConstantInt::get(Type::getInt32Ty(C), IC->getPredicate())});
+        std::vector<Value *> Args = {
+            ConstantInt::get(Int32Ty, Registers.getID(IC)),
+            ConstantInt::get(Int32Ty, BID),
+            ConstantInt::get(Int32Ty, IC->getPredicate())};
+        addOperand(IC->getOperand(0), Builder, Args);
+        addOperand(IC->getOperand(1), Builder, Args);
+        Value *Taken = Builder.CreateICmpNE(
+            Builder.CreateCall(DSEICmpFunction, Args),
+            ConstantInt::get(Int32Ty, 0));
+        Outcomes.push_back(std::make_pair(IC, Taken));
+      } else if (SelectInst *SE = dyn_cast<SelectInst>(&I)) {
+        if (!SE->getType()->isIntegerTy(32) || !DA.isSymbolic(SE))
+          continue;
+        Builder.SetInsertPoint(SE->getNextNode());
+        std::vector<Value *> Args = {
+            ConstantInt::get(Int32Ty, Registers.getID(SE))};
+        addOperand(SE->getCondition(), Builder, Args);
+        addOperand(SE->getTrueValue(), Builder, Args);
+        addOperand(SE->getFalseValue(), Builder, Args);
+        Builder.CreateCall(DSESelectFunction, Args);
+      } else if (CastInst *CI = dyn_cast<CastInst>(&I)) {
+        // casts extend to i32, or truncate to a byte that is stored
+        bool ToByte = isa<TruncInst>(CI) && CI->getType()->isIntegerTy(8);
+        if ((!CI->getType()->isIntegerTy(32) && !ToByte) ||
+            !isSupported(CI->getOperand(0)) || !DA.isSymbolic(CI))
+          continue;
+        Builder.SetInsertPoint(CI->getNextNode());
+        unsigned Width = CI->getOperand(0)->getType()->getIntegerBitWidth();
+        std::vector<Value *> Args = {
+            ConstantInt::get(Int32Ty, Registers.getID(CI)),
+            ConstantInt::get(Int32Ty, CI->getOpcode()),
+            ConstantInt::get(Int32Ty, Width)};
+        addOperand(CI->getOperand(0), Builder, Args);
+        Builder.CreateCall(DSECastFunction, Args);
+      } else if (CallInst *CI = dyn_cast<CallInst>(&I)) {
+        instrumentCall(CI);
+      } else if (ReturnInst *RI = dyn_cast<ReturnInst>(&I)) {
+        Returns.push_back(RI);
+        Value *V = RI->getReturnValue();
+        if (!V || !V->getType()->isIntegerTy(32) || !DA.Returns.count(&F))
+          continue;
+        std::vector<Value *> Args;
+        addOperand(V, Builder, Args);
+        Builder.CreateCall(DSEReturnFunction, Args);
       }
     }
   }
+
+  // The program follows the outcome the runtime returns, which differs from
+  // the comparison in a child forked to take the other side. The uses are
+  // replaced once all users are instrumented, so that their hooks still find
+  // the register of the comparison.
+  for (auto &O : Outcomes) {
+    O.first->replaceAllUsesWith(O.second);
+  }
+
+  // A recursive call runs the same instructions again, so F saves its
+  // registers on entry, before its parameters are copied into them, and
+  // restores them when it returns, after its return value is passed.
+  int Count = Registers.First + Registers.Values.size() - FirstRegister;
+  if (Count == 0)
+    return;
+  IRBuilder<> Builder(Init ? Init->getNextNode()
+                           : &*F.getEntryBlock().getFirstInsertionPt());
+  Builder.CreateCall(DSEEnterFunction,
+                     {ConstantInt::get(Int32Ty, FirstRegister),
+                      ConstantInt::get(Int32Ty, Count)});
+  for (ReturnInst *RI : Returns) {
+    Builder.SetInsertPoint(RI);
+    Builder.CreateCall(DSELeaveFunction);
+  }
+}
+
+// Reads the map file entries of the other modules linked into the same
+// binary, so that the IDs of this module are numbered after theirs.
+void Instrument::readMap(Module &M, const std::string &FileName) {
+  std::ifstream IS(FileName);
+  std::string Line;
+  while (getline(IS, Line)) {
+    std::istringstream SS(Line);
+    std::string Kind, Source;
+    int ID;
+    if (!(SS >> Kind >> ID >> Source) || Source == M.getSourceFileName())
+      continue;
+    MapEntries.push_back(Line);
+    if (Kind == "R")
+      Registers.First = std::max(Registers.First, ID + 1);
+    else if (Kind == "B")
+      Branches.First = std::max(Branches.First, ID + 1);
+  }
+}
+
+std::string describe(Module &M, Value *V) {
+  std::string Str;
+  raw_string_ostream OS(Str);
+  OS << M.getSourceFileName() << " ";
+  if (Instruction *I = dyn_cast<Instruction>(V)) {
+    OS << I->getFunction()->getName() << " ";
+    V->printAsOperand(OS, false);
+    if (const DebugLoc &Loc = I->getDebugLoc())
+      OS << " " << Loc->getFilename() << ":" << Loc.getLine();
+  } else {
+    V->printAsOperand(OS, false);
+  }
+  return OS.str();
+}
+
+// whether the value V is used outside the block that defines it, the entry
+// block for an argument, as values are once mem2reg has promoted the
+// variables; addresses do not depend on the inputs
+static bool isLiveAcrossBlocks(Value *V) {
+  if (!V->getType()->isIntegerTy())
+    return false;
+  if (isa<PHINode>(V))
+    return true;
+  BasicBlock *Def = nullptr;
+  if (Instruction *I = dyn_cast<Instruction>(V))
+    Def = I->getParent();
+  else if (Argument *A = dyn_cast<Argument>(V))
+    Def = &A->getParent()->getEntryBlock();
+  for (User *U : V->users()) {
+    Instruction *I = dyn_cast<Instruction>(U);
+    if (I && I->getParent() != Def)
+      return true;
+  }
+  return false;
+}
+
+// Writes one line per ID: "R|B <id> <source file> <function> <value>
+// [<file>:<line>]". The runtime sizes its register table from it. A line
+// "S <count> <source file>" records the registers of the module that stay
+// live across blocks, which the runtime cannot move to a fork's inputs.
+void Instrument::writeMap(Module &M, const std::string &FileName) {
+  std::ofstream OS(FileName);
+  for (auto &E : MapEntries) {
+    OS << E << "\n";
+  }
+  int Live = std::count_if(Registers.Values.begin(), Registers.Values.end(),
+                           isLiveAcrossBlocks);
+  if (Live > 0)
+    OS << "S " << Live << " " << M.getSourceFileName() << "\n";
+  for (Value *V : Registers.Values) {
+    OS << "R " << Registers.IDs[V] << " " << describe(M, V) << "\n";
+  }
+  for (Value *V : Branches.Values) {
+    OS << "B " << Branches.IDs[V] << " " << describe(M, V) << "\n";
+  }
+}
+
+// Tells the runtime at startup that the module is linked into the binary,
+// so that it only applies the map entries of its own modules.
+void Instrument::registerModule(Module &M) {
+  LLVMContext &C = M.getContext();
+  Function *F = Function::Create(FunctionType::get(Type::getVoidTy(C), false),
+                                 Function::InternalLinkage, "dse.module", &M);
+  IRBuilder<> Builder(BasicBlock::Create(C, "entry", F));
+  Builder.CreateCall(DSEModuleFunction,
+                     {Builder.CreateGlobalStringPtr(M.getSourceFileName())});
+  Builder.CreateRetVoid();
+  appendToGlobalCtors(M, F, 0);
+}
+
+bool Instrument::runOnModule(Module &M) {
+  // IDs continue from the modules already in the map, so the modules of a
+  // program get distinct IDs if they are instrumented with the same map
+  std::string FileName = MapFile;
+  if (FileName.empty()) {
+    FileName = M.getSourceFileName();
+    FileName = FileName.substr(0, FileName.rfind('.')) + ".dsemap";
+  }
+  readMap(M, FileName);
+
+  declare(M);
+  registerModule(M);
+  DA.analyze(M);
+  for (Function &F : M) {
+    if (!F.isDeclaration())
+      instrument(F);
+  }
+
+  writeMap(M, FileName);
   return true;
 }
 
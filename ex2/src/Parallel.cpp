@@ -0,0 +1,354 @@
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "CounterexampleCache.h"
+#include "Coverage.h"
+#include "DSE.h"
+#include "Formula.h"
+#include "Independence.h"
+#include "Strategy.h"
+
+namespace {
+
+// an input to execute, and in fork mode the length of the path prefix it was
+// solved for, after which the program forks
+struct Task {
+  ModelTy Input;
+  int Depth;
+};
+
+struct Worker {
+  Worker(unsigned ID)
+      : ID(ID), Solver(makeSolver(Ctx)), Cache(Ctx),
+        Dir("dse-worker-" + std::to_string(ID)) {}
+
+  std::string getFile(const char *Name) { return Dir + "/" + Name; }
+
+  unsigned ID;
+  z3::context Ctx;
+  z3::solver Solver;
+  CounterexampleCache Cache;
+  TraceBuffer Trace;
+  std::string Dir;
+  // the owner pushes and pops at the back, thieves steal from the front
+  std::deque<Task> Tasks;
+  std::mutex Lock;
+};
+
+class Scheduler {
+public:
+  Scheduler(const std::string &Program, unsigned NumWorkers, int MaxIter,
+            bool Record, bool Fork);
+  // Returns false if the exploration failed, e.g. an execution left no
+  // path condition behind.
+  bool run();
+
+private:
+  void work(Worker &W);
+  bool pop(Worker &W, Task &T);
+  void push(Worker &W, const Task &T, bool NewCoverage);
+  bool execute(Worker &W, int Iter, const Task &T);
+  void fail(const std::string &Message);
+  std::vector<unsigned> markExplored(const z3::expr_vector &Vec);
+  void expand(Worker &W, const ExecutedPath &Path,
+              const std::vector<unsigned> &Prefix);
+  bool claim(unsigned Node, const z3::expr &E, bool &NewCoverage);
+  void queue(Worker &W, const z3::expr_vector &Query, const ModelTy &Inputs,
+             int Depth, bool NewCoverage);
+
+  std::string Program;
+  int MaxIter;
+  bool Record;
+  bool Fork;
+  std::vector<std::unique_ptr<Worker>> Workers;
+  // the branch coverage of all executions
+  CoverageMap Coverage;
+
+  // guards the explored paths, the coverage, the crash, the failure and the
+  // output
+  std::mutex Lock;
+  // the explored paths and the constraints on them, in a context of their
+  // own that the workers translate their constraints into
+  z3::context TreeCtx;
+  PathTree Explored;
+  std::set<unsigned> Covered;
+  bool Crashed = false;
+  int CrashIter = 0;
+  ModelTy CrashInput;
+  // the error of the first execution whose path condition was lost
+  std::string Failure;
+
+  std::atomic<int> Executions;
+  std::atomic<int> Queued;
+  std::atomic<int> Active;
+  std::atomic<bool> Stop;
+  std::mutex IdleLock;
+  std::condition_variable Idle;
+};
+
+Scheduler::Scheduler(const std::string &Program, unsigned NumWorkers,
+                     int MaxIter, bool Record, bool Fork)
+    : Program(Program), MaxIter(MaxIter), Record(Record), Fork(Fork),
+      Explored(TreeCtx), Executions(0), Queued(0), Active(0), Stop(false) {
+  for (unsigned I = 0; I < NumWorkers; I++) {
+    Workers.emplace_back(new Worker(I));
+  }
+}
+
+void Scheduler::push(Worker &W, const Task &T, bool NewCoverage) {
+  {
+    std::lock_guard<std::mutex> Guard(W.Lock);
+    // inputs that reach an uncovered side of a branch run first
+    if (NewCoverage)
+      W.Tasks.push_back(T);
+    else
+      W.Tasks.push_front(T);
+  }
+  Queued++;
+  Idle.notify_one();
+}
+
+bool Scheduler::pop(Worker &W, Task &T) {
+  for (unsigned I = 0; I < Workers.size(); I++) {
+    Worker &Victim = *Workers[(W.ID + I) % Workers.size()];
+    std::lock_guard<std::mutex> Guard(Victim.Lock);
+    if (Victim.Tasks.empty())
+      continue;
+    if (&Victim == &W) {
+      T = W.Tasks.back();
+      W.Tasks.pop_back();
+    } else {
+      T = Victim.Tasks.front();
+      Victim.Tasks.pop_front();
+    }
+    Queued--;
+    return true;
+  }
+  return false;
+}
+
+// Runs the program on the input of T and queues its children. Returns false
+// if the program crashed.
+bool Scheduler::execute(Worker &W, int Iter, const Task &T) {
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    std::cout << "Iter " << Iter << " (worker " << W.ID << ")" << std::endl;
+  }
+  storeInput(T.Input, W.getFile(InputFile));
+  std::string Command = "cd '" + W.Dir + "' && ";
+  if (Fork)
+    Command += "DSE_FORK_DEPTH=" + std::to_string(T.Depth) + " ";
+  Command += "'" + Program + "'";
+  ExecutedPath Path(W.Ctx);
+  int Ret = Record ? runRecorded(Command, W.Trace, Path)
+                   : std::system(Command.c_str());
+  if (Ret)
+    return false;
+  if (!Record) {
+    struct stat Buffer;
+    std::string Formula = W.getFile(FormulaFile);
+    if (stat(Formula.c_str(), &Buffer)) {
+      fail(Formula + " not found");
+      return true;
+    }
+    if (!readFormula(Formula, Path.Vec, Path.Sinks)) {
+      fail("Cannot read " + Formula);
+      return true;
+    }
+  }
+  // the paths of forked processes are executed as well, and are marked
+  // before any branch is negated
+  Path.Inputs = loadInput(W.getFile(InputFile));
+  std::vector<ExecutedPath> Paths(1, Path);
+  if (Fork) {
+    for (auto &F : collectForks(W.Ctx, W.Dir)) {
+      Paths.push_back(F);
+    }
+  }
+  std::vector<std::vector<unsigned>> Prefixes;
+  for (auto &P : Paths) {
+    Prefixes.push_back(markExplored(P.Vec));
+    Stats.addExecution(P.Vec);
+  }
+  for (unsigned I = 0; I < Paths.size(); I++) {
+    expand(W, Paths[I], Prefixes[I]);
+  }
+  return true;
+}
+
+// Stops the exploration, which can no longer claim to be complete.
+void Scheduler::fail(const std::string &Message) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  if (Failure.empty())
+    Failure = Message;
+  Stop = true;
+}
+
+// Returns the nodes of the prefixes of Vec, the empty one first.
+std::vector<unsigned> Scheduler::markExplored(const z3::expr_vector &Vec) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  std::vector<unsigned> Prefix(1, PathTree::Root);
+  for (unsigned I = 0; I < Vec.size(); I++) {
+    Prefix.push_back(Explored.extend(Prefix.back(), Vec[I]));
+    // the tree keeps the constraint alive, and with it its id
+    Covered.insert(Explored.import(Vec[I]).id());
+  }
+  return Prefix;
+}
+
+// Claims the query of the path prefix Node followed by E, so that no other
+// worker solves it as well. Returns false if it was claimed before.
+bool Scheduler::claim(unsigned Node, const z3::expr &E, bool &NewCoverage) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  bool Inserted;
+  Explored.extend(Node, E, Inserted);
+  if (!Inserted)
+    return false;
+  NewCoverage = !Covered.count(Explored.import(E).id());
+  return true;
+}
+
+// Solves Query and queues the inputs of its model.
+void Scheduler::queue(Worker &W, const z3::expr_vector &Query,
+                      const ModelTy &Inputs, int Depth, bool NewCoverage) {
+  ModelTy Model;
+  if (solve(W.Solver, W.Cache, sliceQuery(Query), Model) != z3::sat)
+    return;
+  ModelTy Next = Inputs;
+  for (auto &E : Model) {
+    Next[E.first] = E.second;
+  }
+  push(W, {Next, Depth}, NewCoverage);
+}
+
+void Scheduler::expand(Worker &W, const ExecutedPath &Path,
+                       const std::vector<unsigned> &Prefix) {
+  const z3::expr_vector &Vec = Path.Vec;
+  for (unsigned I = 0; I < Vec.size() && !Stop; I++) {
+    z3::expr Negated = negate(Vec[I]);
+    bool NewCoverage;
+    if (!claim(Prefix[I], Negated, NewCoverage))
+      continue;
+    z3::expr_vector Query(W.Ctx);
+    for (unsigned J = 0; J < I; J++) {
+      Query.push_back(Vec[J]);
+    }
+    Query.push_back(Negated);
+    queue(W, Query, Path.Inputs, I + 1, NewCoverage);
+  }
+  // queued last, the inputs reaching a sink run before those of the negated
+  // branches
+  for (unsigned I = 0; I < Path.Sinks.size() && !Stop; I++) {
+    int Depth = std::min(Path.Sinks[I].first, (int)Vec.size());
+    bool NewCoverage;
+    if (claim(Prefix[Depth], Path.Sinks[I].second, NewCoverage))
+      queue(W, sinkQuery(Path, I), Path.Inputs, Depth, true);
+  }
+}
+
+void Scheduler::work(Worker &W) {
+  while (!Stop) {
+    Active++;
+    Task T;
+    if (pop(W, T)) {
+      int Iter = Executions++;
+      if (Iter >= MaxIter) {
+        Executions--;
+        Stop = true;
+      } else if (!execute(W, Iter, T)) {
+        std::lock_guard<std::mutex> Guard(Lock);
+        if (!Crashed) {
+          Stats.addCrash();
+          Crashed = true;
+          CrashIter = Iter;
+          CrashInput = loadInput(W.getFile(InputFile));
+        }
+        Stop = true;
+      } else {
+        std::lock_guard<std::mutex> Guard(Lock);
+        reportStats(Coverage.count());
+      }
+      Active--;
+      Idle.notify_all();
+      continue;
+    }
+    Active--;
+    std::unique_lock<std::mutex> Guard(IdleLock);
+    // a busy worker may still queue new tasks
+    if (Queued == 0 && Active == 0) {
+      Stop = true;
+      Idle.notify_all();
+      return;
+    }
+    Idle.wait_for(Guard, std::chrono::milliseconds(10));
+  }
+}
+
+bool Scheduler::run() {
+  // the workers run the program from their own directories
+  char Cwd[PATH_MAX];
+  if (!getcwd(Cwd, sizeof(Cwd)) || !Coverage.create(CoverageFile)) {
+    std::cerr << "Cannot create " << CoverageFile << std::endl;
+    return false;
+  }
+  setenv("DSE_COVERAGE", (std::string(Cwd) + "/" + CoverageFile).c_str(), 1);
+  for (auto &W : Workers) {
+    mkdir(W->Dir.c_str(), 0755);
+    if (Record && !W->Trace.create(W->getFile(TraceFile).c_str(),
+                                   DefaultTraceCapacity)) {
+      std::cerr << "Cannot create " << W->getFile(TraceFile) << std::endl;
+      return false;
+    }
+  }
+  push(*Workers[0], {loadInput(), 0}, true);
+
+  std::vector<std::thread> Threads;
+  for (auto &W : Workers) {
+    Worker *Ptr = W.get();
+    Threads.emplace_back([this, Ptr] { work(*Ptr); });
+  }
+  for (auto &T : Threads) {
+    T.join();
+  }
+
+  if (Crashed) {
+    std::cout << "Crashing input found (" << CrashIter << " iters)"
+              << std::endl;
+    // like the sequential driver, leave the crashing input behind
+    storeInput(CrashInput);
+  } else if (!Failure.empty()) {
+    std::cerr << Failure << std::endl;
+  } else if (Executions < MaxIter) {
+    std::cout << "All paths explored (" << Executions << " iters)"
+              << std::endl;
+  }
+  reportStats(Coverage.count(), true);
+  for (unsigned I = 1; I < Workers.size(); I++) {
+    Workers[0]->Cache.mergeStats(Workers[I]->Cache);
+  }
+  Workers[0]->Cache.print(std::cout);
+  return Crashed || Failure.empty();
+}
+
+} // namespace
+
+bool exploreParallel(const std::string &Program, unsigned NumWorkers,
+                     int MaxIter, bool Record, bool Fork) {
+  Stats.setWorkers(NumWorkers);
+  Scheduler S(Program, NumWorkers, MaxIter, Record, Fork);
+  return S.run();
+}
@@ -1,77 +1,509 @@
+#include <algorithm>
+#include <climits>
+#include <ctime>
+#include <fcntl.h>
+#include <fstream>
 #include <iostream>
+#include <set>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-#include "llvm/IR/InstrTypes.h"
-#include "llvm/IR/Instruction.h"
-
+#include "Coverage.h"
+#include "Formula.h"
 #include "SymbolicInterpreter.h"
+#include "Trace.h"
+
+z3::context Ctx;
+SymbolicInterpreter SI(Ctx);
+
+// In record mode the hooks only append events to the trace, and the driver
+// builds the symbolic state by replaying it.
+TraceBuffer Trace;
+bool Recording = false;
+
+// In fuzz mode the hooks only fill the branch coverage map, which the other
+// modes fill as well when the driver maps it.
+CoverageMap Coverage;
+bool Fuzzing = false;
+
+// In fork mode the program forks at every symbolic branch whose other side is
+// feasible, and the child continues on that side. The state shared by all
+// processes of an execution lives in an anonymous shared mapping.
+struct ForkState {
+  int Live;
+  int Next;
+  // the fork ID of the first child that crashed
+  int Crash;
+};
+ForkState *Forks = nullptr;
+int MaxForks = 16;
+// The driver sets the fork depth to the length of the path prefix it solved
+// for. The other sides of the branches in the prefix are explored already,
+// so only the branches after it fork.
+int ForkDepth = 0;
+// the ID of this process, 0 for the initial one
+int ForkID = 0;
+// whether the program keeps input-dependent values in registers across
+// blocks, which a fork cannot move to its inputs, see adoptModel
+bool RegisterState = false;
+// the source files of the instrumented modules linked into the binary
+std::set<std::string> Modules;
+std::map<pid_t, int> Children;
+// the symbolic cells of memory that hold a byte, which a fork rewrites as
+// such
+std::set<uintptr_t> ByteCells;
+
+// The bytes of DSE_InputBuffer come from a read-only mapping of the input
+// buffer file, consumed in order. Bytes past its end are zero.
+const uint8_t *InputBytes = nullptr;
+size_t NumInputBytes = 0;
+int NextByte = 0;
+
+void print(std::ostream &OS) {
+  OS << "=== Inputs ===" << std::endl;
+  for (auto &E : SI.getInputs()) {
+    OS << "X" << E.first << " : " << E.second << std::endl;
+  }
+  if (!SI.getBytes().empty())
+    OS << "B0 .. B" << SI.getBytes().rbegin()->first << std::endl;
+  OS << std::endl;
+  OS << "=== Pointers ===" << std::endl;
+  for (auto &E : SI.getPointers()) {
+    OS << "R" << E.first << " : " << E.second << std::endl;
+  }
+  OS << std::endl;
+  OS << "=== Symbolic Registers ===" << std::endl;
+  for (int I = 0; I < (int)SI.getRegisters().size(); I++) {
+    if (SI.getRegisters()[I].isSymbolic())
+      OS << "R" << I << " : " << SI.getRegisters()[I] << std::endl;
+  }
+  OS << std::endl;
+  OS << "=== Symbolic Memory ===" << std::endl;
+  OS << SI.getMemory();
+  OS << std::endl;
+
+  OS << "=== Path Condition ===" << std::endl;
+  for (auto &E : SI.getPathCondition()) {
+    std::string BID = "B" + std::to_string(E.first);
+    OS << BID << " : " << E.second << std::endl;
+  }
+  OS << std::endl;
+  OS << "=== Dropped Constraints ===" << std::endl;
+  for (auto &E : SI.getDropped()) {
+    OS << "B" << E.first << " : " << E.second << std::endl;
+  }
+  OS << std::endl;
+  OS << "=== Summarized Constraints ===" << std::endl;
+  for (auto &E : SI.getSummarized()) {
+    OS << "B" << E.first << " : " << E.second << std::endl;
+  }
+}
+
+void writeInputs(const std::string &FileName) {
+  std::ofstream Input(FileName);
+  for (auto &E : SI.getInputs()) {
+    Input << "X" << E.first << "," << E.second << "\n";
+  }
+  if (SI.getBytes().empty())
+    return;
+  std::string Bytes(SI.getBytes().rbegin()->first + 1, '\0');
+  for (auto &E : SI.getBytes()) {
+    Bytes[E.first] = (char)E.second;
+  }
+  std::ofstream Buffer(getBufferFile(FileName), std::ios::binary);
+  Buffer.write(Bytes.data(), Bytes.size());
+}
+
+// Reaps the forked children, recording the first one that crashed.
+void reapForks(bool Block) {
+  int Status;
+  pid_t Pid;
+  while ((Pid = waitpid(-1, &Status, Block ? 0 : WNOHANG)) > 0) {
+    auto It = Children.find(Pid);
+    if (It == Children.end())
+      continue;
+    __atomic_sub_fetch(&Forks->Live, 1, __ATOMIC_SEQ_CST);
+    if (!WIFEXITED(Status) || WEXITSTATUS(Status) != 0) {
+      int None = 0;
+      __atomic_compare_exchange_n(&Forks->Crash, &None, It->second, false,
+                                  __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+    Children.erase(It);
+  }
+}
 
-extern SymbolicInterpreter SI;
+extern "C" void __DSE_Exit__() {
+  // forks write their files under their ID
+  auto getFile = [](const char *Name) {
+    return ForkID ? getForkFile(Name, ForkID) : std::string(Name);
+  };
+  if (Fuzzing) {
+    writeInputs(InputFile);
+    return;
+  }
+  if (Forks)
+    reapForks(true);
+  if (!Recording) {
+    std::ofstream Branch(getFile(BranchFile));
+    for (auto &E : SI.getPathCondition()) {
+      Branch << "B" << E.first << "\n";
+    }
+    if (!writeFormula(getFile(FormulaFile), SI.getPathCondition(),
+                      SI.getSinks()))
+      std::cerr << "Cannot write " << getFile(FormulaFile) << std::endl;
+  }
+  // record the concrete inputs so that the inputs the next query does not
+  // constrain keep their values
+  writeInputs(getFile(InputFile));
+  if (ForkID)
+    return;
+  std::ofstream Log(LogFile);
+  print(Log);
+  // report a crash of any fork as a crash of the execution
+  if (Forks && Forks->Crash) {
+    std::string Crash = getForkFile(InputFile, Forks->Crash);
+    for (auto &File : {std::string(InputFile), getBufferFile(InputFile)}) {
+      std::ifstream From(File == InputFile ? Crash : getBufferFile(Crash),
+                         std::ios::binary);
+      if (!From)
+        continue;
+      std::ofstream To(File, std::ios::binary);
+      To << From.rdbuf();
+    }
+    _exit(1);
+  }
+}
 
-// helper function for the stack-based arithmetic
-z3::expr pop(MemoryTy &Mem) {
-  z3::expr SE = SI.getStack().top();
-  SI.getStack().pop();
-  if (SE.to_string().at(0) == 'R') {
-    int RID = std::stoi(SE.to_string().substr(1));
-    return Mem.at(Address(RID));
-  } else
-    return SE;
+// Moves a forked child to the inputs of Model. The symbolic cells of memory
+// are rewritten with their values under the new inputs. Values the program
+// keeps in registers across the branch are not, so fork mode is disabled for
+// programs that do, e.g. after mem2reg.
+void adoptModel(const z3::model &Model) {
+  // inputs the model leaves open keep their values
+  z3::expr_vector From(SI.getContext());
+  z3::expr_vector To(SI.getContext());
+  int Val;
+  for (auto &E : SI.getInputs()) {
+    z3::expr Input = SI.makeInput(E.first);
+    if (SymbolicInterpreter::getValue(Model.eval(Input), Val))
+      E.second = Val;
+    From.push_back(Input);
+    To.push_back(SI.makeValue(E.second));
+  }
+  for (auto &E : SI.getBytes()) {
+    z3::expr Input = SI.makeByteInput(E.first);
+    if (SymbolicInterpreter::getValue(Model.eval(Input), Val))
+      E.second = Val & 0xff;
+    From.push_back(Input);
+    To.push_back(SI.makeValue(E.second));
+  }
+  for (auto &E : SI.getMemory().getCells()) {
+    z3::expr Cell = E.second;
+    if (!SymbolicInterpreter::getValue(Cell.substitute(From, To).simplify(),
+                                       Val))
+      continue;
+    if (ByteCells.count(E.first))
+      *(uint8_t *)E.first = Val;
+    else
+      *(int *)E.first = Val;
+  }
+}
+
+// Forks a child that takes the other side of the branch just added to the
+// path condition, if that side is feasible and fewer than MaxForks forks are
+// live. Returns the outcome of the branch in the calling process.
+bool forkBranch(int R, bool Taken) {
+  reapForks(false);
+  if (Forks->Crash ||
+      __atomic_load_n(&Forks->Live, __ATOMIC_SEQ_CST) >= MaxForks)
+    return Taken;
+  auto &PC = SI.getPathCondition();
+  z3::expr Last = PC.back().second;
+  z3::expr Other = Taken ? !Last : Last.arg(0);
+  z3::solver Solver(SI.getContext());
+  for (size_t I = 0; I + 1 < PC.size(); I++) {
+    Solver.add(PC[I].second);
+  }
+  Solver.add(Other);
+  if (Solver.check() != z3::sat)
+    return Taken;
+  z3::model Model = Solver.get_model();
+
+  int ID = __atomic_add_fetch(&Forks->Next, 1, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&Forks->Live, 1, __ATOMIC_SEQ_CST);
+  // buffered output would be written by both processes
+  std::fflush(nullptr);
+  pid_t Pid = fork();
+  if (Pid < 0) {
+    __atomic_sub_fetch(&Forks->Live, 1, __ATOMIC_SEQ_CST);
+    return Taken;
+  }
+  if (Pid > 0) {
+    Children[Pid] = ID;
+    return Taken;
+  }
+  ForkID = ID;
+  Children.clear();
+  PC.back().second = Other;
+  SI.setRegister(R, SymValue(!Taken, SI.getRegister(R).getExpr()));
+  adoptModel(Model);
+  // written now as the child may not exit normally
+  writeInputs(getForkFile(InputFile, ForkID));
+  return !Taken;
+}
+
+// Sizes the register table from the ID map of the binary, DSE_MAP if set,
+// else <binary>.dsemap. Also notes whether any module linked into the binary
+// keeps registers live across blocks.
+void readMap() {
+  std::ifstream Map;
+  if (const char *Env = std::getenv("DSE_MAP")) {
+    Map.open(Env);
+  } else {
+    char Exe[PATH_MAX];
+    ssize_t Len = readlink("/proc/self/exe", Exe, sizeof(Exe) - 1);
+    if (Len <= 0)
+      return;
+    Map.open(std::string(Exe, Len) + MapSuffix);
+  }
+  std::string Line;
+  int NumRegisters = 0;
+  while (getline(Map, Line)) {
+    std::istringstream SS(Line);
+    std::string Kind, Source;
+    int ID;
+    if (!(SS >> Kind >> ID))
+      continue;
+    if (Kind == "R")
+      NumRegisters = std::max(NumRegisters, ID + 1);
+    else if (Kind == "S" && SS >> Source && Modules.count(Source))
+      RegisterState = true;
+  }
+  if (NumRegisters > 0)
+    SI.getRegisters().resize(NumRegisters, SymValue(SI.getContext(), 0));
+}
+
+extern "C" void __DSE_Module__(const char *Source) {
+  Modules.insert(Source);
+}
+
+extern "C" void __DSE_Init__() {
+  std::srand(std::time(nullptr));
+  std::string Line;
+  std::ifstream Input(InputFile);
+  if (Input.is_open()) {
+    while (getline(Input, Line)) {
+      int ID = std::stoi(Line.substr(1, Line.find(",")));
+      int Val = std::stoi(Line.substr(Line.find(",") + 1));
+      SI.getInputs()[ID] = Val;
+    }
+  }
+  readMap();
+  int FD = open(InputBufferFile, O_RDONLY);
+  struct stat Buffer;
+  if (FD >= 0 && !fstat(FD, &Buffer) && Buffer.st_size > 0) {
+    void *Addr =
+        mmap(nullptr, Buffer.st_size, PROT_READ, MAP_PRIVATE, FD, 0);
+    if (Addr != MAP_FAILED) {
+      InputBytes = (const uint8_t *)Addr;
+      NumInputBytes = Buffer.st_size;
+    }
+  }
+  if (FD >= 0)
+    close(FD);
+  if (const char *Env = std::getenv("DSE_BRANCH_BUDGET"))
+    SI.setBranchBudget(std::atoi(Env));
+  if (const char *Env = std::getenv("DSE_BV_WIDTH"))
+    SI.setBitWidth(std::atoi(Env));
+  if (const char *Env = std::getenv("DSE_SIMPLIFY"))
+    SI.setSimplify(std::atoi(Env));
+  const char *Mode = std::getenv("DSE_MODE");
+  if (Mode && std::string(Mode) == "record")
+    Recording = Trace.open(TraceFile);
+  if (Mode && std::string(Mode) == "fuzz")
+    Fuzzing = true;
+  if (const char *Env = std::getenv("DSE_COVERAGE"))
+    Coverage.open(Env);
+  if (Mode && std::string(Mode) == "fork" && !RegisterState) {
+    void *Addr = mmap(nullptr, sizeof(ForkState), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    // the mapping starts zeroed
+    if (Addr != MAP_FAILED)
+      Forks = (ForkState *)Addr;
+    if (const char *Env = std::getenv("DSE_MAX_FORKS"))
+      MaxForks = std::atoi(Env);
+    if (const char *Env = std::getenv("DSE_FORK_DEPTH"))
+      ForkDepth = std::atoi(Env);
+  } else if (Mode && std::string(Mode) == "fork") {
+    // the driver explores the other sides itself
+    std::cerr << "Fork mode is disabled, the program keeps input-dependent "
+                 "values in registers across blocks"
+              << std::endl;
+  }
+  std::atexit(__DSE_Exit__);
+}
+
+extern "C" void __DSE_Input__(int *X, int ID) {
+  *X = SI.NewInput(ID);
+  if (Recording)
+    Trace.append(InputEvent, {addrLo(X), addrHi(X), ID, *X});
+  else if (!Fuzzing)
+    SI.visitInput((uintptr_t)X, ID, *X);
+}
+
+extern "C" void __DSE_InputBuffer__(char *Buf, int Len) {
+  for (int I = 0; I < Len; I++) {
+    int Offset = NextByte++;
+    int Val = (size_t)Offset < NumInputBytes ? InputBytes[Offset] : 0;
+    Buf[I] = (char)Val;
+    SI.getBytes()[Offset] = Val;
+    if (Recording) {
+      Trace.append(InputByteEvent,
+                   {addrLo(Buf + I), addrHi(Buf + I), Offset, Val});
+    } else if (!Fuzzing) {
+      SI.visitInputByte((uintptr_t)(Buf + I), Offset, Val);
+      if (Forks)
+        ByteCells.insert((uintptr_t)(Buf + I));
+    }
+  }
 }
 
 /*
  * Implement your transfer functions.
  */
 extern "C" void __DSE_Alloca__(int R, int *Ptr) {
-  MemoryTy &Mem = SI.getMemory();
-  Address Addr(R);
-  z3::expr SE = SI.getContext().int_val((intptr_t)Ptr);
-  Mem.insert(std::make_pair(Addr, SE));
+  if (Recording)
+    Trace.append(AllocaEvent, {R, addrLo(Ptr), addrHi(Ptr)});
+  else if (!Fuzzing)
+    SI.visitAlloca(R, (uintptr_t)Ptr);
 }
 
-extern "C" void __DSE_Store__(int R) {
-  MemoryTy &Mem = SI.getMemory();
-  z3::expr Addr = Mem.at(Address(R)); // get value from symbolic register
-  Address MAddr =
-      Address((int *)std::stoll(Addr.to_string())); // create symbolic memory
-  Mem.insert(std::make_pair(MAddr, pop(Mem)));
+extern "C" void __DSE_Store__(int *Ptr, int ID, int Val) {
+  if (Recording) {
+    Trace.append(StoreEvent, {addrLo(Ptr), addrHi(Ptr), ID, Val});
+  } else if (!Fuzzing) {
+    SI.visitStore((uintptr_t)Ptr, ID, Val);
+    ByteCells.erase((uintptr_t)Ptr);
+  }
 }
 
 extern "C" void __DSE_Load__(int Y, int *X) {
-  MemoryTy &Mem = SI.getMemory();
-  Address Addr(Y);
-  z3::expr SE = Mem.at(Address(X));
-  Mem.insert(std::make_pair(Addr, SE));
-}
-
-extern "C" void __DSE_ICmp__(int R, int Op) {
-  MemoryTy &Mem = SI.getMemory();
-  z3::expr RHS = pop(Mem);
-  z3::expr LHS = pop(Mem);
-  switch (Op) {
-  case llvm::CmpInst::ICMP_EQ:
-    SI.getPathCondition().push_back(std::make_pair(R, LHS == RHS));
-    break;
-  case llvm::CmpInst::ICMP_SGT:
-    SI.getPathCondition().push_back(std::make_pair(R, LHS > RHS));
-    break;
-  }
-}
-
-extern "C" void __DSE_BinOp__(int R, int Op) {
-  MemoryTy &Mem = SI.getMemory();
-  z3::expr RHS = pop(Mem);
-  z3::expr LHS = pop(Mem);
-  switch (Op) {
-  case llvm::Instruction::Add:
-    Mem.insert(std::make_pair(Address(R), LHS + RHS));
-    break;
-  case llvm::Instruction::Mul:
-    Mem.insert(std::make_pair(Address(R), LHS * RHS));
-    break;
-  case llvm::Instruction::SRem:
-    Mem.insert(std::make_pair(Address(R), z3::rem(LHS, RHS)));
-    break;
-  default:
-    return;
+  if (Recording)
+    Trace.append(LoadEvent, {Y, addrLo(X), addrHi(X), *X});
+  else if (!Fuzzing)
+    SI.visitLoad(Y, (uintptr_t)X, *X);
+}
+
+// The value of a byte store is the truncated register, which the store
+// instrumentation passes as is.
+extern "C" void __DSE_StoreByte__(char *Ptr, int ID, int Val) {
+  Val = (uint8_t)Val;
+  if (Recording) {
+    Trace.append(StoreEvent, {addrLo(Ptr), addrHi(Ptr), ID, Val});
+  } else if (!Fuzzing) {
+    SI.visitStore((uintptr_t)Ptr, ID, Val);
+    if (Forks)
+      ByteCells.insert((uintptr_t)Ptr);
+  }
+}
+
+extern "C" void __DSE_LoadByte__(int Y, char *X) {
+  int Val = *(uint8_t *)X;
+  if (Recording)
+    Trace.append(LoadByteEvent, {Y, addrLo(X), addrHi(X), Val});
+  else if (!Fuzzing)
+    SI.visitLoadByte(Y, (uintptr_t)X, Val);
+}
+
+// Returns the outcome of the comparison, which decides the branches on it.
+extern "C" int __DSE_ICmp__(int R, int B, int Op, int LID, int LVal, int RID,
+                            int RVal) {
+  bool Taken = SymbolicInterpreter::compare(Op, LVal, RVal);
+  if (Recording) {
+    Trace.append(ICmpEvent, {R, B, Op, LID, LVal, RID, RVal});
+  } else if (!Fuzzing) {
+    size_t Size = SI.getPathCondition().size();
+    SI.visitICmp(R, B, Op, LID, LVal, RID, RVal);
+    if (Forks && SI.getPathCondition().size() > Size &&
+        (int)Size >= ForkDepth)
+      Taken = forkBranch(R, Taken);
   }
+  if (B >= 0 && Coverage.isOpen())
+    Coverage.hit(B, Taken);
+  return Taken;
+}
+
+extern "C" void __DSE_BinOp__(int R, int Op, int LID, int LVal, int RID,
+                              int RVal) {
+  if (Recording)
+    Trace.append(BinOpEvent, {R, Op, LID, LVal, RID, RVal});
+  else if (!Fuzzing)
+    SI.visitBinOp(R, Op, LID, LVal, RID, RVal);
+}
+
+extern "C" void __DSE_Phi__(int R, int ID, int Val, int Last) {
+  if (Recording)
+    Trace.append(PhiEvent, {R, ID, Val, Last});
+  else if (!Fuzzing)
+    SI.visitPhi(R, ID, Val, Last);
+}
+
+extern "C" void __DSE_Select__(int R, int CID, int CVal, int TID, int TVal,
+                               int FID, int FVal) {
+  if (Recording)
+    Trace.append(SelectEvent, {R, CID, CVal, TID, TVal, FID, FVal});
+  else if (!Fuzzing)
+    SI.visitSelect(R, CID, CVal, TID, TVal, FID, FVal);
+}
+
+extern "C" void __DSE_Cast__(int R, int Op, int Width, int ID, int Val) {
+  if (Recording)
+    Trace.append(CastEvent, {R, Op, Width, ID, Val});
+  else if (!Fuzzing)
+    SI.visitCast(R, Op, Width, ID, Val);
+}
+
+extern "C" void __DSE_Arg__(int I, int ID, int Val) {
+  if (Recording)
+    Trace.append(ArgEvent, {I, ID, Val});
+  else if (!Fuzzing)
+    SI.visitArg(I, ID, Val);
+}
+
+extern "C" void __DSE_Param__(int R, int I, int Val) {
+  if (Recording)
+    Trace.append(ParamEvent, {R, I, Val});
+  else if (!Fuzzing)
+    SI.visitParam(R, I, Val);
+}
+
+extern "C" void __DSE_Return__(int ID, int Val) {
+  if (Recording)
+    Trace.append(ReturnEvent, {ID, Val});
+  else if (!Fuzzing)
+    SI.visitReturn(ID, Val);
+}
+
+extern "C" void __DSE_CallResult__(int R, int Val) {
+  if (Recording)
+    Trace.append(CallResultEvent, {R, Val});
+  else if (!Fuzzing)
+    SI.visitCallResult(R, Val);
+}
+
+extern "C" void __DSE_Enter__(int First, int Count) {
+  if (Recording)
+    Trace.append(EnterEvent, {First, Count});
+  else if (!Fuzzing)
+    SI.visitEnter(First, Count);
+}
+
+extern "C" void __DSE_Leave__() {
+  if (Recording)
+    Trace.append(LeaveEvent, {});
+  else if (!Fuzzing)
+    SI.visitLeave();
 }
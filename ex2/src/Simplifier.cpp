@@ -0,0 +1,240 @@
+#include "Simplifier.h"
+
+#include <algorithm>
+
+#include "llvm/IR/Instruction.h"
+
+static unsigned getID(const z3::expr &E) { return Z3_get_ast_id(E.ctx(), E); }
+
+// the order of the atoms of a linear form
+static bool before(const std::pair<z3::expr, int64_t> &A,
+                   const std::pair<z3::expr, int64_t> &B) {
+  unsigned HA = Z3_get_ast_hash(A.first.ctx(), A.first);
+  unsigned HB = Z3_get_ast_hash(B.first.ctx(), B.first);
+  if (HA != HB)
+    return HA < HB;
+  return getID(A.first) < getID(B.first);
+}
+
+void Simplifier::setBitWidth(unsigned W) {
+  BitWidth = W;
+  clear();
+}
+
+void Simplifier::clear() {
+  Forms.clear();
+  Memo.clear();
+}
+
+bool Simplifier::simplify(int Op, const z3::expr &LE, const z3::expr &RE,
+                          z3::expr &Result) {
+  MemoKey Key(Op, getID(LE), getID(RE));
+  auto It = Memo.find(Key);
+  if (It != Memo.end()) {
+    if (It->second.Rewritten)
+      Result = It->second.Result;
+    return It->second.Rewritten;
+  }
+  if (size() >= MaxEntries)
+    clear();
+  z3::expr E(Ctx);
+  bool Rewritten = rewrite(Op, LE, RE, E);
+  Memo.emplace(Key, MemoEntry{LE, RE, E, Rewritten});
+  if (Rewritten)
+    Result = E;
+  return Rewritten;
+}
+
+bool Simplifier::rewrite(int Op, const z3::expr &LE, const z3::expr &RE,
+                         z3::expr &Result) {
+  int64_t L, R;
+  bool LNum = getNumeral(LE, L);
+  bool RNum = getNumeral(RE, R);
+  // all bits set, -1 as a program value
+  int64_t Ones = BitWidth ? (int64_t)getMask() : -1;
+  Linear Form;
+  switch (Op) {
+  case llvm::Instruction::Add:
+  case llvm::Instruction::Sub:
+    if (!combine(getLinear(LE), getLinear(RE),
+                 Op == llvm::Instruction::Sub ? -1 : 1, Form))
+      return false;
+    Result = build(Form);
+    return true;
+  case llvm::Instruction::Mul:
+    if (!LNum && !RNum)
+      return false;
+    if (!scale(getLinear(LNum ? RE : LE), LNum ? L : R, Form))
+      return false;
+    Result = build(Form);
+    return true;
+  case llvm::Instruction::Shl:
+    if (!RNum)
+      return false;
+    if (!scale(getLinear(LE), (int64_t)1 << (R & 31), Form))
+      return false;
+    Result = build(Form);
+    return true;
+  case llvm::Instruction::LShr:
+  case llvm::Instruction::AShr:
+    if (RNum && (R & 31) == 0) {
+      Result = LE;
+      return true;
+    }
+    return false;
+  case llvm::Instruction::SDiv:
+  case llvm::Instruction::UDiv:
+    if (RNum && R == 1) {
+      Result = LE;
+      return true;
+    }
+    // X / -1 is -X, which wraps around like the division for the minimum
+    if (Op == llvm::Instruction::SDiv && RNum && R == Ones) {
+      if (!scale(getLinear(LE), Ones, Form))
+        return false;
+      Result = build(Form);
+      return true;
+    }
+    return false;
+  case llvm::Instruction::SRem:
+  case llvm::Instruction::URem:
+    if (RNum && (R == 1 || (Op == llvm::Instruction::SRem && R == Ones))) {
+      Result = makeNumeral(0);
+      return true;
+    }
+    return false;
+  case llvm::Instruction::And:
+    if ((LNum && L == 0) || (RNum && R == 0))
+      Result = makeNumeral(0);
+    else if (RNum && R == Ones)
+      Result = LE;
+    else if (LNum && L == Ones)
+      Result = RE;
+    else if (z3::eq(LE, RE))
+      Result = LE;
+    else
+      return false;
+    return true;
+  case llvm::Instruction::Or:
+    if ((LNum && L == Ones) || (RNum && R == Ones))
+      Result = makeNumeral(-1);
+    else if (RNum && R == 0)
+      Result = LE;
+    else if (LNum && L == 0)
+      Result = RE;
+    else if (z3::eq(LE, RE))
+      Result = LE;
+    else
+      return false;
+    return true;
+  case llvm::Instruction::Xor:
+    if (RNum && R == 0)
+      Result = LE;
+    else if (LNum && L == 0)
+      Result = RE;
+    else if (z3::eq(LE, RE))
+      Result = makeNumeral(0);
+    else
+      return false;
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Bit-vector numerals are kept as their bits, truncated to the width.
+bool Simplifier::getNumeral(const z3::expr &E, int64_t &Val) {
+  if (!BitWidth)
+    return E.is_numeral_i64(Val);
+  uint64_t U;
+  if (!E.is_numeral_u64(U))
+    return false;
+  Val = (int64_t)U;
+  return true;
+}
+
+z3::expr Simplifier::makeNumeral(int64_t Val) {
+  if (!BitWidth)
+    return Ctx.int_val(Val);
+  return Ctx.bv_val((uint64_t)Val, BitWidth);
+}
+
+Simplifier::Linear Simplifier::getLinear(const z3::expr &E) {
+  Linear L;
+  if (getNumeral(E, L.Constant))
+    return L;
+  auto It = Forms.find(getID(E));
+  if (It != Forms.end())
+    return It->second.L;
+  L.Terms.push_back(std::make_pair(E, 1));
+  return L;
+}
+
+// Integer coefficients fail on overflow, bit-vector ones wrap around.
+bool Simplifier::add(int64_t A, int64_t B, int64_t &Sum) {
+  if (!BitWidth)
+    return !__builtin_add_overflow(A, B, &Sum);
+  Sum = (int64_t)(((uint64_t)A + (uint64_t)B) & getMask());
+  return true;
+}
+
+bool Simplifier::mul(int64_t A, int64_t B, int64_t &Product) {
+  if (!BitWidth)
+    return !__builtin_mul_overflow(A, B, &Product);
+  Product = (int64_t)(((uint64_t)A * (uint64_t)B) & getMask());
+  return true;
+}
+
+// Result = L + Scale * R
+bool Simplifier::combine(const Linear &L, const Linear &R, int64_t Scale,
+                         Linear &Result) {
+  Linear Scaled;
+  if (!scale(R, Scale, Scaled) ||
+      !add(L.Constant, Scaled.Constant, Result.Constant))
+    return false;
+  std::vector<std::pair<z3::expr, int64_t>> Terms = L.Terms;
+  Terms.insert(Terms.end(), Scaled.Terms.begin(), Scaled.Terms.end());
+  std::sort(Terms.begin(), Terms.end(), before);
+  for (auto &T : Terms) {
+    if (!Result.Terms.empty() && z3::eq(Result.Terms.back().first, T.first)) {
+      int64_t &C = Result.Terms.back().second;
+      if (!add(C, T.second, C))
+        return false;
+      if (C == 0)
+        Result.Terms.pop_back();
+    } else {
+      Result.Terms.push_back(T);
+    }
+  }
+  return true;
+}
+
+bool Simplifier::scale(const Linear &L, int64_t Factor, Linear &Result) {
+  if (!mul(L.Constant, Factor, Result.Constant))
+    return false;
+  for (auto &T : L.Terms) {
+    int64_t C;
+    if (!mul(T.second, Factor, C))
+      return false;
+    if (C != 0)
+      Result.Terms.push_back(std::make_pair(T.first, C));
+  }
+  return true;
+}
+
+z3::expr Simplifier::build(const Linear &L) {
+  if (L.Terms.empty())
+    return makeNumeral(L.Constant);
+  z3::expr E(Ctx);
+  for (auto &T : L.Terms) {
+    z3::expr Term =
+        T.second == 1 ? T.first : makeNumeral(T.second) * T.first;
+    E = (Z3_ast)E ? E + Term : Term;
+  }
+  if (L.Constant)
+    E = E + makeNumeral(L.Constant);
+  // atoms are their own linear form
+  if (L.Terms.size() > 1 || L.Terms[0].second != 1 || L.Constant)
+    Forms.emplace(getID(E), Form{E, L});
+  return E;
+}
@@ -0,0 +1,168 @@
+#include "Stats.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+void CampaignStats::addExecution(const z3::expr_vector &Vec) {
+  // structural hashes are the same in the contexts of all workers
+  uint64_t Hash = 0;
+  for (unsigned I = 0; I < Vec.size(); I++) {
+    Hash = Hash * 1000003 ^ Z3_get_ast_hash(Vec.ctx(), Vec[I]);
+  }
+  std::lock_guard<std::mutex> Guard(Lock);
+  Executions++;
+  LastLength = Vec.size();
+  MaxLength = std::max(MaxLength, LastLength);
+  TotalLength += Vec.size();
+  Paths.insert(Hash);
+}
+
+void CampaignStats::addFuzzExecution() {
+  std::lock_guard<std::mutex> Guard(Lock);
+  FuzzExecutions++;
+}
+
+void CampaignStats::addQuery(z3::check_result Result, double Time) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  if (Result == z3::sat)
+    Sat++;
+  else if (Result == z3::unsat)
+    Unsat++;
+  else
+    Unknown++;
+  SolveTimes.push_back(Time);
+  SolveTime += Time;
+}
+
+void CampaignStats::addCrash() {
+  std::lock_guard<std::mutex> Guard(Lock);
+  if (FirstCrash < 0)
+    FirstCrash = getElapsed();
+}
+
+void CampaignStats::setCovered(size_t Covered) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  if (Covered > this->Covered)
+    Curve.push_back({getElapsed(), Executions + FuzzExecutions, Covered});
+  this->Covered = Covered;
+}
+
+bool CampaignStats::isDue(double Interval) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  auto Now = std::chrono::steady_clock::now();
+  if (std::chrono::duration<double>(Now - Last).count() < Interval)
+    return false;
+  Last = Now;
+  return true;
+}
+
+static double getPercentile(std::vector<double> &Times, double P) {
+  if (Times.empty())
+    return 0;
+  auto N = Times.begin() + (size_t)(P * (Times.size() - 1));
+  std::nth_element(Times.begin(), N, Times.end());
+  return *N;
+}
+
+double CampaignStats::getElapsed() const {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       Start)
+      .count();
+}
+
+CampaignStats::Snapshot CampaignStats::take() {
+  std::lock_guard<std::mutex> Guard(Lock);
+  Snapshot S;
+  S.Elapsed = getElapsed();
+  S.Executions = Executions;
+  S.FuzzExecutions = FuzzExecutions;
+  S.Queries = Sat + Unsat + Unknown;
+  S.Sat = Sat;
+  S.Unsat = Unsat;
+  S.Unknown = Unknown;
+  S.SolveTime = SolveTime;
+  S.Workers = Workers;
+  std::vector<double> Times = SolveTimes;
+  S.P50 = getPercentile(Times, 0.5);
+  S.P90 = getPercentile(Times, 0.9);
+  S.P99 = getPercentile(Times, 0.99);
+  S.Max = getPercentile(Times, 1);
+  S.LastLength = LastLength;
+  S.MeanLength = Executions ? (double)TotalLength / Executions : 0;
+  S.MaxLength = MaxLength;
+  S.Paths = Paths.size();
+  S.Covered = Covered;
+  S.FirstCrash = FirstCrash;
+  S.Curve = Curve;
+  return S;
+}
+
+void CampaignStats::print(std::ostream &OS) {
+  Snapshot S = take();
+  double Elapsed = std::max(S.Elapsed, 1e-9);
+  int Executions = S.Executions + S.FuzzExecutions;
+  char Line[512];
+  std::snprintf(Line, sizeof(Line),
+                "[stats] %.1fs: %d execs (%.1f/s), %d queries (%.1f/s, %d "
+                "unknown), solve p50 %.1fms p90 %.1fms p99 %.1fms max "
+                "%.1fms, path length %d (mean %.1f, max %d), %zu unique "
+                "paths, %zu branch sides covered",
+                S.Elapsed, Executions, Executions / Elapsed, S.Queries,
+                S.Queries / Elapsed, S.Unknown, S.P50 * 1000, S.P90 * 1000,
+                S.P99 * 1000, S.Max * 1000, S.LastLength, S.MeanLength,
+                S.MaxLength, S.Paths, S.Covered);
+  OS << Line << std::endl;
+}
+
+bool CampaignStats::write(const std::string &FileName) {
+  Snapshot S = take();
+  double Elapsed = std::max(S.Elapsed, 1e-9);
+  int Executions = S.Executions + S.FuzzExecutions;
+  std::string Temp = FileName + ".tmp";
+  {
+    std::ofstream OS(Temp);
+    if (!OS)
+      return false;
+    OS << "{\n";
+    OS << "  \"elapsed\": " << S.Elapsed << ",\n";
+    OS << "  \"executions\": " << Executions << ",\n";
+    OS << "  \"fuzz_executions\": " << S.FuzzExecutions << ",\n";
+    OS << "  \"executions_per_sec\": " << Executions / Elapsed << ",\n";
+    OS << "  \"queries\": " << S.Queries << ",\n";
+    OS << "  \"queries_per_sec\": " << S.Queries / Elapsed << ",\n";
+    OS << "  \"sat\": " << S.Sat << ",\n";
+    OS << "  \"unsat\": " << S.Unsat << ",\n";
+    OS << "  \"unknown\": " << S.Unknown << ",\n";
+    OS << "  \"solve_time\": {\"total\": " << S.SolveTime
+       << ", \"p50\": " << S.P50 << ", \"p90\": " << S.P90
+       << ", \"p99\": " << S.P99 << ", \"max\": " << S.Max << "},\n";
+    OS << "  \"path_length\": {\"last\": " << S.LastLength
+       << ", \"mean\": " << S.MeanLength << ", \"max\": " << S.MaxLength
+       << "},\n";
+    OS << "  \"unique_paths\": " << S.Paths << ",\n";
+    // the share of the workers' time spent in the solver
+    OS << "  \"solver_share\": " << S.SolveTime / (Elapsed * S.Workers)
+       << ",\n";
+    OS << "  \"time_to_crash\": ";
+    if (S.FirstCrash < 0)
+      OS << "null";
+    else
+      OS << S.FirstCrash;
+    OS << ",\n";
+    // one point per line, so that curves diff line by line
+    OS << "  \"coverage_curve\": [";
+    for (size_t I = 0; I < S.Curve.size(); I++) {
+      const CurvePoint &P = S.Curve[I];
+      OS << (I ? "," : "") << "\n    {\"elapsed\": " << P.Elapsed
+         << ", \"executions\": " << P.Executions
+         << ", \"covered\": " << P.Covered << "}";
+    }
+    OS << (S.Curve.empty() ? "],\n" : "\n  ],\n");
+    OS << "  \"covered_branch_sides\": " << S.Covered << "\n";
+    OS << "}\n";
+    if (!OS)
+      return false;
+  }
+  return std::rename(Temp.c_str(), FileName.c_str()) == 0;
+}
@@ -1,15 +1,84 @@
 #include "Strategy.h"
 
+#include <vector>
+
+const unsigned PathTree::Root;
+
+z3::expr PathTree::import(const z3::expr &E) {
+  if (&E.ctx() == &Ctx)
+    return E;
+  return z3::expr(Ctx, Z3_translate(E.ctx(), E, Ctx));
+}
+
+unsigned PathTree::extend(unsigned N, const z3::expr &E, bool &Inserted) {
+  z3::expr T = import(E);
+  auto It = Children.find(std::make_pair(N, T.id()));
+  Inserted = It == Children.end();
+  if (!Inserted)
+    return It->second;
+  Terms.push_back(T);
+  unsigned Child = Children.size() + 1;
+  Children[std::make_pair(N, T.id())] = Child;
+  return Child;
+}
+
+// The tree of the sequential driver, in the context of its path conditions.
+// Unlike bare AST ids, which Z3 reuses once a term is freed, or hashes,
+// which collide, its nodes identify the explored paths exactly.
+static PathTree &getSeen(z3::context &Ctx) {
+  static PathTree Seen(Ctx);
+  return Seen;
+}
+
+z3::expr negate(const z3::expr &E) {
+  if (E.is_app() && E.decl().decl_kind() == Z3_OP_NOT)
+    return E.arg(0);
+  return !E;
+}
+
+void markExplored(const z3::expr_vector &Path) {
+  PathTree &Seen = getSeen(Path.ctx());
+  unsigned Node = PathTree::Root;
+  for (unsigned I = 0; I < Path.size(); I++) {
+    Node = Seen.extend(Node, Path[I]);
+  }
+}
+
+bool markQuery(const z3::expr_vector &Query) {
+  PathTree &Seen = getSeen(Query.ctx());
+  unsigned Node = PathTree::Root;
+  bool Inserted = false;
+  for (unsigned I = 0; I < Query.size(); I++) {
+    Node = Seen.extend(Node, Query[I], Inserted);
+  }
+  return Inserted;
+}
+
 /*
  * Implement your search strategy.
  */
-void searchStrategy(z3::expr_vector &OldVec) {
-  // give equal to the highest priority
-//   for (int i = 0; i < OldVec.size(); i++) {
-//     if (OldVec[i].is_eq()) {
-//       z3::expr tmp = OldVec[0];
-//       OldVec[0] = OldVec[i];
-//       OldVec[i] = tmp;
-//     }
-//   }
+bool searchStrategy(z3::expr_vector &OldVec) {
+  PathTree &Seen = getSeen(OldVec.ctx());
+  // every prefix of the current path has been executed already
+  std::vector<unsigned> Prefix(1, PathTree::Root);
+  for (unsigned I = 0; I < OldVec.size(); I++) {
+    Prefix.push_back(Seen.extend(Prefix.back(), OldVec[I]));
+  }
+
+  // negate the deepest branch whose other side has not been tried yet
+  for (int I = (int)OldVec.size() - 1; I >= 0; I--) {
+    z3::expr Negated = negate(OldVec[I]);
+    bool Inserted;
+    Seen.extend(Prefix[I], Negated, Inserted);
+    if (!Inserted)
+      continue;
+    z3::expr_vector NewVec(OldVec.ctx());
+    for (int J = 0; J < I; J++) {
+      NewVec.push_back(OldVec[J]);
+    }
+    NewVec.push_back(Negated);
+    OldVec = NewVec;
+    return true;
+  }
+  return false;
 }
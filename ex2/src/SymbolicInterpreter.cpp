@@ -1,18 +1,72 @@
 #include "SymbolicInterpreter.h"
 
-#include <ctime>
-#include <fstream>
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Instruction.h"
 
-std::ostream &operator<<(std::ostream &OS, const Address &A) {
-  if (A.Type == A.Memory) {
-    OS << A.Addr;
+#include <algorithm>
+
+std::ostream &operator<<(std::ostream &OS, const SymValue &V) {
+  if (V.isSymbolic()) {
+    OS << V.Expr;
   } else {
-    OS << "R" << A.Addr;
+    OS << V.Concrete;
   }
   return OS;
 }
 
-int SymbolicInterpreter::NewInput(int *Ptr, int ID) {
+std::vector<z3::expr> *ShadowMemory::getPage(uintptr_t Page, bool Create) {
+  if (LastSlots && LastPage == Page)
+    return LastSlots;
+  auto It = Pages.find(Page);
+  if (It == Pages.end()) {
+    if (!Create)
+      return nullptr;
+    It = Pages.emplace(Page, std::vector<z3::expr>(PageSize, z3::expr(Ctx)))
+             .first;
+  }
+  LastPage = Page;
+  LastSlots = &It->second;
+  return LastSlots;
+}
+
+SymValue ShadowMemory::load(uintptr_t Addr, int Concrete) {
+  std::vector<z3::expr> *Slots = getPage(Addr >> PageBits, false);
+  if (!Slots)
+    return SymValue(Ctx, Concrete);
+  z3::expr &E = (*Slots)[Addr & (PageSize - 1)];
+  if ((Z3_ast)E == nullptr)
+    return SymValue(Ctx, Concrete);
+  return SymValue(Concrete, E);
+}
+
+void ShadowMemory::store(uintptr_t Addr, const SymValue &V) {
+  // concrete stores only need to clear pages that already exist
+  std::vector<z3::expr> *Slots = getPage(Addr >> PageBits, V.isSymbolic());
+  if (!Slots)
+    return;
+  (*Slots)[Addr & (PageSize - 1)] =
+      V.isSymbolic() ? V.getExpr() : z3::expr(Ctx);
+}
+
+std::map<uintptr_t, z3::expr> ShadowMemory::getCells() const {
+  std::map<uintptr_t, z3::expr> Cells;
+  for (auto &P : Pages) {
+    for (uintptr_t I = 0; I < PageSize; I++) {
+      if ((Z3_ast)P.second[I] != nullptr)
+        Cells.emplace((P.first << PageBits) + I, P.second[I]);
+    }
+  }
+  return Cells;
+}
+
+std::ostream &operator<<(std::ostream &OS, const ShadowMemory &M) {
+  for (auto &E : M.getCells()) {
+    OS << E.first << " : " << E.second << std::endl;
+  }
+  return OS;
+}
+
+int SymbolicInterpreter::NewInput(int ID) {
   int Ret = 0;
   if (Inputs.find(ID) != Inputs.end()) {
     Ret = Inputs[ID];
@@ -20,82 +74,566 @@ int SymbolicInterpreter::NewInput(int *Ptr, int ID) {
     Ret = std::rand() % (1 << 16); // limit the test time of the infeasable
     Inputs[ID] = Ret;
   }
-  Address X(Ptr);
-  std::string InputName = "X" + std::to_string(NumOfInputs);
-  z3::expr SE = Ctx.int_const(InputName.c_str());
-  Mem.insert(std::make_pair(X, SE));
-  NumOfInputs++;
   return Ret;
 }
 
-SymbolicInterpreter SI;
+z3::expr SymbolicInterpreter::makeInput(int ID) {
+  std::string InputName = "X" + std::to_string(ID);
+  if (!BitWidth)
+    return Ctx.int_const(InputName.c_str());
+  // the inputs are 32-bit values however wide the arithmetic is
+  z3::expr Input = Ctx.bv_const(InputName.c_str(), 32);
+  return BitWidth > 32 ? z3::sext(Input, BitWidth - 32) : Input;
+}
+
+z3::expr SymbolicInterpreter::makeByteInput(int Offset) {
+  std::string InputName = "B" + std::to_string(Offset);
+  if (!BitWidth)
+    return Ctx.int_const(InputName.c_str());
+  return Ctx.bv_const(InputName.c_str(), BitWidth);
+}
+
+z3::expr SymbolicInterpreter::toByte(const z3::expr &E) {
+  int Mask;
+  // the byte of another byte, e.g. of a copied input byte, is the same
+  if (E.is_app() && E.num_args() == 2 && getValue(E.arg(1), Mask) &&
+      ((E.decl().decl_kind() == Z3_OP_MOD && Mask == 256) ||
+       (E.decl().decl_kind() == Z3_OP_BAND && Mask == 255)))
+    return E;
+  if (!BitWidth)
+    return z3::mod(E, 256);
+  return E & makeValue(255);
+}
+
+z3::expr SymbolicInterpreter::makeValue(int Val) {
+  if (BitWidth)
+    return Ctx.bv_val(Val, BitWidth);
+  return Ctx.int_val(Val);
+}
 
-void print(std::ostream &OS) {
-  OS << "=== Inputs ===" << std::endl;
-  int Idx = 0;
-  for (auto &E : SI.getInputs()) {
-    OS << "X" << E.first << " : " << E.second << std::endl;
+bool SymbolicInterpreter::getValue(const z3::expr &E, int &Val) {
+  if (E.is_bv()) {
+    // bit-vector numerals are unsigned, truncating them to 32 bits restores
+    // the sign
+    uint64_t U;
+    if (!E.is_numeral_u64(U))
+      return false;
+    Val = (int)(uint32_t)U;
+    return true;
   }
-  OS << std::endl;
-  OS << "=== Symbolic Memory ===" << std::endl;
-  for (auto &E : SI.getMemory()) {
-    OS << E.first << " : " << E.second << std::endl;
+  int64_t I;
+  if (!E.is_numeral_i64(I))
+    return false;
+  Val = (int)I;
+  return true;
+}
+
+z3::solver SymbolicInterpreter::makeSolver(z3::context &Ctx,
+                                           unsigned BitWidth,
+                                           unsigned Timeout) {
+  if (!BitWidth) {
+    z3::solver Solver(Ctx);
+    if (Timeout)
+      Solver.set("timeout", Timeout);
+    return Solver;
   }
-  OS << std::endl;
+  // bit-blast the query into a SAT problem
+  z3::tactic BitBlast = z3::tactic(Ctx, "simplify") &
+                        z3::tactic(Ctx, "solve-eqs") &
+                        z3::tactic(Ctx, "bit-blast") & z3::tactic(Ctx, "sat");
+  if (Timeout)
+    BitBlast = z3::try_for(BitBlast, Timeout);
+  return BitBlast.mk_solver();
+}
+
+void SymbolicInterpreter::visitInput(uintptr_t Addr, int ID, int Val) {
+  Inputs[ID] = Val;
+  Mem.store(Addr, SymValue(Val, makeInput(ID)));
+  NumOfInputs++;
+}
+
+void SymbolicInterpreter::visitInputByte(uintptr_t Addr, int Offset,
+                                         int Val) {
+  Bytes[Offset] = Val;
+  Mem.store(Addr, SymValue(Val, makeByte(Offset)));
+}
+
+// The instrumentation passes each operand as its register ID, or -1 if the
+// operand is statically known to be concrete, together with its concrete value.
+SymValue SymbolicInterpreter::operand(int ID, int Val) {
+  if (ID >= 0) {
+    const SymValue &V = getRegister(ID);
+    if (V.isSymbolic())
+      return SymValue(Val, V.getExpr());
+  }
+  return SymValue(Ctx, Val);
+}
+
+// takes the value passed through an argument or return slot
+SymValue SymbolicInterpreter::take(SymValue &Slot, int Val) {
+  SymValue V = Slot.isSymbolic() ? SymValue(Val, Slot.getExpr())
+                                 : SymValue(Ctx, Val);
+  // calls from uninstrumented code must not see a stale value
+  Slot = SymValue(Ctx, 0);
+  return V;
+}
+
+void SymbolicInterpreter::visitEnter(int First, int Count) {
+  if (First + Count > (int)Registers.size())
+    Registers.resize(First + Count, SymValue(Ctx, 0));
+  auto Begin = Registers.begin() + First;
+  Frames.emplace_back(First, std::vector<SymValue>(Begin, Begin + Count));
+}
+
+void SymbolicInterpreter::visitLeave() {
+  if (Frames.empty())
+    return;
+  auto &Frame = Frames.back();
+  std::copy(Frame.second.begin(), Frame.second.end(),
+            Registers.begin() + Frame.first);
+  Frames.pop_back();
+}
+
+// 32-bit two's complement semantics of the binary operators
+static int evaluate(int Op, int LHS, int RHS) {
+  uint32_t L = LHS, R = RHS;
+  switch (Op) {
+  case llvm::Instruction::Add:
+    return L + R;
+  case llvm::Instruction::Sub:
+    return L - R;
+  case llvm::Instruction::Mul:
+    return L * R;
+  case llvm::Instruction::SDiv:
+    return (R == 0 || (LHS == INT32_MIN && RHS == -1)) ? 0 : LHS / RHS;
+  case llvm::Instruction::UDiv:
+    return R == 0 ? 0 : L / R;
+  case llvm::Instruction::SRem:
+    return (R == 0 || (LHS == INT32_MIN && RHS == -1)) ? 0 : LHS % RHS;
+  case llvm::Instruction::URem:
+    return R == 0 ? 0 : L % R;
+  case llvm::Instruction::And:
+    return L & R;
+  case llvm::Instruction::Or:
+    return L | R;
+  case llvm::Instruction::Xor:
+    return L ^ R;
+  case llvm::Instruction::Shl:
+    return L << (R & 31);
+  case llvm::Instruction::LShr:
+    return L >> (R & 31);
+  case llvm::Instruction::AShr:
+    return LHS >> (R & 31);
+  default:
+    return 0;
+  }
+}
 
-  OS << "=== Path Condition ===" << std::endl;
-  for (auto &E : SI.getPathCondition()) {
-    std::string BID = "B" + std::to_string(E.first);
-    OS << BID << " : " << E.second << std::endl;
+// The bit-vector encoding of the integer binary operator Op. Shift amounts
+// are masked like evaluate does.
+static z3::expr bitVectorOp(int Op, const z3::expr &LE, const z3::expr &RE) {
+  switch (Op) {
+  case llvm::Instruction::Add:
+    return LE + RE;
+  case llvm::Instruction::Sub:
+    return LE - RE;
+  case llvm::Instruction::Mul:
+    return LE * RE;
+  case llvm::Instruction::SDiv:
+    return LE / RE;
+  case llvm::Instruction::UDiv:
+    return z3::udiv(LE, RE);
+  case llvm::Instruction::SRem:
+    return z3::srem(LE, RE);
+  case llvm::Instruction::URem:
+    return z3::urem(LE, RE);
+  case llvm::Instruction::And:
+    return LE & RE;
+  case llvm::Instruction::Or:
+    return LE | RE;
+  case llvm::Instruction::Xor:
+    return LE ^ RE;
+  case llvm::Instruction::Shl:
+    return z3::shl(LE, RE & 31);
+  case llvm::Instruction::LShr:
+    return z3::lshr(LE, RE & 31);
+  case llvm::Instruction::AShr:
+  default:
+    return z3::ashr(LE, RE & 31);
   }
 }
 
-extern "C" void __DSE_Exit__() {
-  z3::solver Solver(SI.getContext());
-  std::ofstream Branch(BranchFile);
-  for (auto &E : SI.getPathCondition()) {
-    std::string BID = "B" + std::to_string(E.first);
-    Solver.add(E.second);
-    Branch << BID << "\n";
+bool SymbolicInterpreter::compare(int Op, int LHS, int RHS) {
+  uint32_t L = LHS, R = RHS;
+  switch (Op) {
+  case llvm::CmpInst::ICMP_EQ:
+    return LHS == RHS;
+  case llvm::CmpInst::ICMP_NE:
+    return LHS != RHS;
+  case llvm::CmpInst::ICMP_SGT:
+    return LHS > RHS;
+  case llvm::CmpInst::ICMP_SGE:
+    return LHS >= RHS;
+  case llvm::CmpInst::ICMP_SLT:
+    return LHS < RHS;
+  case llvm::CmpInst::ICMP_SLE:
+    return LHS <= RHS;
+  case llvm::CmpInst::ICMP_UGT:
+    return L > R;
+  case llvm::CmpInst::ICMP_UGE:
+    return L >= R;
+  case llvm::CmpInst::ICMP_ULT:
+    return L < R;
+  case llvm::CmpInst::ICMP_ULE:
+    return L <= R;
+  default:
+    return false;
   }
-  std::ofstream Smt2(FormulaFile);
-  Smt2 << Solver.to_smt2();
-  std::ofstream Log(LogFile);
-  print(Log);
 }
 
-extern "C" void __DSE_Init__() {
-  std::srand(std::time(nullptr));
-  std::string Line;
-  std::ifstream Input(InputFile);
-  if (Input.is_open()) {
-    while (getline(Input, Line)) {
-      int ID = std::stoi(Line.substr(1, Line.find(",")));
-      int Val = std::stoi(Line.substr(Line.find(",") + 1));
-      SI.getInputs()[ID] = Val;
+void SymbolicInterpreter::visitAlloca(int R, uintptr_t Addr) {
+  Pointers[R] = Addr;
+  // the slot may still hold a value of an earlier stack frame
+  Mem.clear(Addr);
+}
+
+void SymbolicInterpreter::visitStore(uintptr_t Addr, int ID, int Val) {
+  Mem.store(Addr, operand(ID, Val));
+}
+
+void SymbolicInterpreter::visitLoad(int R, uintptr_t Addr, int Val) {
+  setRegister(R, Mem.load(Addr, Val));
+}
+
+// The slot of Addr holds a byte, or the value of a wider store to Addr whose
+// low byte is at Addr.
+void SymbolicInterpreter::visitLoadByte(int R, uintptr_t Addr, int Val) {
+  SymValue V = Mem.load(Addr, Val);
+  if (V.isSymbolic())
+    V = SymValue(Val, toByte(V.getExpr()));
+  setRegister(R, V);
+}
+
+void SymbolicInterpreter::visitICmp(int R, int B, int Op, int LID, int LVal,
+                                    int RID, int RVal) {
+  SymValue LHS = operand(LID, LVal);
+  SymValue RHS = operand(RID, RVal);
+  bool Taken = compare(Op, LVal, RVal);
+  setRegister(R, SymValue(Ctx, Taken));
+  // comparisons of concrete values do not constrain the inputs
+  if (!LHS.isSymbolic() && !RHS.isSymbolic())
+    return;
+  z3::expr LE = toExpr(LHS);
+  z3::expr RE = toExpr(RHS);
+  // integers compare unsigned as their 32-bit two's complement
+  auto toUnsigned = [&](const z3::expr &E) {
+    return z3::ite(E < 0, E + Ctx.int_val((int64_t)1 << 32), E);
+  };
+  bool Unsigned = llvm::CmpInst::isUnsigned((llvm::CmpInst::Predicate)Op);
+  // sums that differ by a constant, e.g. X + 1 < X + 2, compare the same on
+  // every path; bit-vector sums may wrap around
+  z3::expr Diff(Ctx);
+  if (Simplify && !BitWidth && !Unsigned && LHS.isSymbolic() &&
+      RHS.isSymbolic() &&
+      Simp.simplify(llvm::Instruction::Sub, LE, RE, Diff) && Diff.is_numeral())
+    return;
+  if (Unsigned && !BitWidth) {
+    LE = toUnsigned(LE);
+    RE = toUnsigned(RE);
+  }
+  z3::expr Cond(Ctx);
+  switch (Op) {
+  case llvm::CmpInst::ICMP_EQ:
+    Cond = LE == RE;
+    break;
+  case llvm::CmpInst::ICMP_NE:
+    Cond = LE != RE;
+    break;
+  case llvm::CmpInst::ICMP_SGT:
+    Cond = LE > RE;
+    break;
+  case llvm::CmpInst::ICMP_SGE:
+    Cond = LE >= RE;
+    break;
+  case llvm::CmpInst::ICMP_SLT:
+    Cond = LE < RE;
+    break;
+  case llvm::CmpInst::ICMP_SLE:
+    Cond = LE <= RE;
+    break;
+  case llvm::CmpInst::ICMP_UGT:
+    Cond = BitWidth ? z3::ugt(LE, RE) : LE > RE;
+    break;
+  case llvm::CmpInst::ICMP_UGE:
+    Cond = BitWidth ? z3::uge(LE, RE) : LE >= RE;
+    break;
+  case llvm::CmpInst::ICMP_ULT:
+    Cond = BitWidth ? z3::ult(LE, RE) : LE < RE;
+    break;
+  case llvm::CmpInst::ICMP_ULE:
+    Cond = BitWidth ? z3::ule(LE, RE) : LE <= RE;
+    break;
+  default:
+    return;
+  }
+  setRegister(R, SymValue(Taken, Cond));
+  // record the side of the branch this execution takes, comparisons that
+  // are only used as data (B < 0) are encoded by their users
+  if (B >= 0)
+    addConstraint(B, Taken ? Cond : !Cond);
+}
+
+// the comparison of R Op L for L Op R
+static Z3_decl_kind mirror(Z3_decl_kind Op) {
+  switch (Op) {
+  case Z3_OP_LT:
+    return Z3_OP_GT;
+  case Z3_OP_LE:
+    return Z3_OP_GE;
+  case Z3_OP_GT:
+    return Z3_OP_LT;
+  case Z3_OP_GE:
+    return Z3_OP_LE;
+  default:
+    return Op;
+  }
+}
+
+// the comparison of !(L Op R)
+static Z3_decl_kind invert(Z3_decl_kind Op) {
+  switch (Op) {
+  case Z3_OP_LT:
+    return Z3_OP_GE;
+  case Z3_OP_LE:
+    return Z3_OP_GT;
+  case Z3_OP_GT:
+    return Z3_OP_LE;
+  case Z3_OP_GE:
+    return Z3_OP_LT;
+  case Z3_OP_EQ:
+    return Z3_OP_DISTINCT;
+  default:
+    return Z3_OP_EQ;
+  }
+}
+
+// Matches C against the bound Term Op K. Numeral offsets of Term are folded
+// into K, so that the conditions of a loop over i = i + 1 share their Term.
+static bool matchBound(z3::expr C, z3::expr &Term, Z3_decl_kind &Op,
+                       int64_t &K) {
+  bool Negated = false;
+  while (C.is_app() && C.decl().decl_kind() == Z3_OP_NOT) {
+    C = C.arg(0);
+    Negated = !Negated;
+  }
+  if (!C.is_app() || C.num_args() != 2)
+    return false;
+  Op = C.decl().decl_kind();
+  if (Op != Z3_OP_LT && Op != Z3_OP_LE && Op != Z3_OP_GT && Op != Z3_OP_GE &&
+      Op != Z3_OP_EQ && Op != Z3_OP_DISTINCT)
+    return false;
+  z3::expr L = C.arg(0);
+  z3::expr R = C.arg(1);
+  if (L.is_numeral()) {
+    std::swap(L, R);
+    Op = mirror(Op);
+  }
+  if (!R.is_numeral_i64(K))
+    return false;
+  if (Negated)
+    Op = invert(Op);
+  int64_t Offset;
+  while (L.is_app() && L.num_args() == 2) {
+    Z3_decl_kind Kind = L.decl().decl_kind();
+    if (Kind == Z3_OP_ADD && L.arg(1).is_numeral_i64(Offset)) {
+      K -= Offset;
+      L = L.arg(0);
+    } else if (Kind == Z3_OP_ADD && L.arg(0).is_numeral_i64(Offset)) {
+      K -= Offset;
+      L = L.arg(1);
+    } else if (Kind == Z3_OP_SUB && L.arg(1).is_numeral_i64(Offset)) {
+      K += Offset;
+      L = L.arg(0);
+    } else {
+      break;
     }
   }
-  std::atexit(__DSE_Exit__);
+  Term = L;
+  return true;
 }
 
-extern "C" void __DSE_Input__(int *X, int ID) { *X = (int)SI.NewInput(X, ID); }
+// Whether the bound C implies the bound P on the same term.
+static bool strengthens(const z3::expr &C, const z3::expr &P) {
+  z3::expr CTerm(C.ctx()), PTerm(P.ctx());
+  Z3_decl_kind COp, POp;
+  int64_t CK, PK;
+  if (!matchBound(C, CTerm, COp, CK) || !matchBound(P, PTerm, POp, PK) ||
+      COp != POp || !z3::eq(CTerm, PTerm))
+    return false;
+  switch (COp) {
+  case Z3_OP_LT:
+  case Z3_OP_LE:
+    return CK <= PK;
+  case Z3_OP_GT:
+  case Z3_OP_GE:
+    return CK >= PK;
+  default:
+    return CK == PK;
+  }
+}
 
-extern "C" void __DSE_Branch__(int BID, int RID, int B) {
-  MemoryTy &Mem = SI.getMemory();
-  Address Addr(RID);
-  z3::expr SE = Mem.at(Addr);
-  z3::expr Cond =
-      B ? SI.getContext().bool_val(true) : SI.getContext().bool_val(false);
-  SI.getPathCondition().push_back(std::make_pair(BID, SE == Cond));
+void SymbolicInterpreter::addConstraint(int B, const z3::expr &C) {
+  if (BranchBudget <= 0) {
+    PathCondition.push_back(std::make_pair(B, C));
+    return;
+  }
+  auto It = Kept.find(B);
+  if (It != Kept.end()) {
+    // Only the end of the path is replaced: a branch recorded after Last,
+    // or a sink, was reached under Last and not under C.
+    size_t Index = It->second.second;
+    z3::expr &Last = PathCondition[Index].second;
+    if (Index + 1 == PathCondition.size() && Index >= SinkPrefix &&
+        strengthens(C, Last)) {
+      Last = C;
+      Summarized[B]++;
+      return;
+    }
+    if (It->second.first >= BranchBudget) {
+      Dropped[B]++;
+      return;
+    }
+  }
+  auto &Count = Kept[B];
+  Count.first++;
+  Count.second = PathCondition.size();
+  PathCondition.push_back(std::make_pair(B, C));
+}
+
+// Z3 divides integers with a non-negative remainder, C rounds toward zero,
+// e.g. -7 / 2 is -4 in Z3 and -3 in C. The two agree on a non-negative
+// dividend whatever the sign of the divisor.
+static z3::expr truncatedDiv(const z3::expr &LE, const z3::expr &RE) {
+  return z3::ite(LE >= 0, LE / RE, -((-LE) / RE));
+}
+
+void SymbolicInterpreter::visitBinOp(int R, int Op, int LID, int LVal,
+                                     int RID, int RVal) {
+  SymValue LHS = operand(LID, LVal);
+  SymValue RHS = operand(RID, RVal);
+  int Concrete = evaluate(Op, LHS.getConcrete(), RHS.getConcrete());
+  if (!LHS.isSymbolic() && !RHS.isSymbolic()) {
+    setRegister(R, SymValue(Ctx, Concrete));
+    return;
+  }
+  z3::expr LE = toExpr(LHS);
+  z3::expr RE = toExpr(RHS);
+  if (RHS.isSymbolic() &&
+      (Op == llvm::Instruction::SDiv || Op == llvm::Instruction::UDiv ||
+       Op == llvm::Instruction::SRem || Op == llvm::Instruction::URem))
+    addSink(R, RE == 0);
+  z3::expr E(Ctx);
+  if (Simplify && Simp.simplify(Op, LE, RE, E)) {
+    // the operands may cancel out, e.g. in X - X
+    setRegister(R, E.is_numeral() ? SymValue(Ctx, Concrete)
+                                  : SymValue(Concrete, E));
+    return;
+  }
+  if (BitWidth) {
+    setRegister(R, SymValue(Concrete, bitVectorOp(Op, LE, RE)));
+    return;
+  }
+  switch (Op) {
+  case llvm::Instruction::Add:
+    setRegister(R, SymValue(Concrete, LE + RE));
+    break;
+  case llvm::Instruction::Sub:
+    setRegister(R, SymValue(Concrete, LE - RE));
+    break;
+  case llvm::Instruction::Mul:
+    setRegister(R, SymValue(Concrete, LE * RE));
+    break;
+  case llvm::Instruction::SDiv:
+    setRegister(R, SymValue(Concrete, truncatedDiv(LE, RE)));
+    break;
+  case llvm::Instruction::SRem:
+    setRegister(R, SymValue(Concrete, LE - RE * truncatedDiv(LE, RE)));
+    break;
+  default:
+    // operators without an integer encoding are concretized
+    setRegister(R, SymValue(Ctx, Concrete));
+    break;
+  }
 }
 
-extern "C" void __DSE_Const__(int X) {
-  z3::expr SE = SI.getContext().int_val(X);
-  SI.getStack().push(SE);
+void SymbolicInterpreter::addSink(int R, const z3::expr &Cond) {
+  // a division in a loop is checked a bounded number of times
+  int &Count = SinkCounts[R];
+  if (BranchBudget > 0 && Count >= BranchBudget)
+    return;
+  Count++;
+  SinkPrefix = PathCondition.size();
+  Sinks.push_back(std::make_pair((int)SinkPrefix, Cond));
 }
 
-extern "C" void __DSE_Register__(int X) {
-  std::string Name = "R" + std::to_string(X);
-  z3::expr SE = SI.getContext().int_const(Name.c_str());
-  SI.getStack().push(SE);
+void SymbolicInterpreter::visitPhi(int R, int ID, int Val, bool Last) {
+  // the PHIs of a block read their incoming values before any is written
+  PendingPhis.push_back(std::make_pair(R, operand(ID, Val)));
+  if (Last) {
+    for (auto &E : PendingPhis) {
+      setRegister(E.first, E.second);
+    }
+    PendingPhis.clear();
+  }
+}
+
+void SymbolicInterpreter::visitSelect(int R, int CID, int CVal, int TID,
+                                      int TVal, int FID, int FVal) {
+  SymValue Cond = operand(CID, CVal);
+  SymValue T = operand(TID, TVal);
+  SymValue F = operand(FID, FVal);
+  if (!Cond.isSymbolic()) {
+    setRegister(R, CVal ? T : F);
+    return;
+  }
+  z3::expr E = z3::ite(Cond.getExpr(), toExpr(T), toExpr(F));
+  setRegister(R, SymValue(CVal ? TVal : FVal, E));
+}
+
+void SymbolicInterpreter::visitCast(int R, int Op, int Width, int ID,
+                                    int Val) {
+  // the only casts to i32 from a supported type extend an i1 or a byte, Val
+  // is the operand zero-extended; the only other cast truncates an i32 to
+  // the unsigned value of its low byte
+  SymValue V = operand(ID, Val);
+  if (Op == llvm::Instruction::Trunc) {
+    int Concrete = (uint8_t)Val;
+    if (!V.isSymbolic())
+      setRegister(R, SymValue(Ctx, Concrete));
+    else
+      setRegister(R, SymValue(Concrete, toByte(V.getExpr())));
+    return;
+  }
+  bool Signed = Op == llvm::Instruction::SExt;
+  if (Width == 8) {
+    int Concrete = Signed ? (int8_t)Val : (uint8_t)Val;
+    if (!V.isSymbolic()) {
+      setRegister(R, SymValue(Ctx, Concrete));
+      return;
+    }
+    z3::expr E = V.getExpr();
+    if (Signed && BitWidth)
+      E = (E ^ makeValue(0x80)) - makeValue(0x80);
+    else if (Signed)
+      E = z3::ite(E >= 128, E - 256, E);
+    setRegister(R, SymValue(Concrete, E));
+    return;
+  }
+  int One = Signed ? -1 : 1;
+  if (!V.isSymbolic() || !V.getExpr().is_bool()) {
+    setRegister(R, SymValue(Ctx, Val ? One : 0));
+    return;
+  }
+  z3::expr E = z3::ite(V.getExpr(), makeValue(One), makeValue(0));
+  setRegister(R, SymValue(Val ? One : 0, E));
 }
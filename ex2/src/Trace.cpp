@@ -0,0 +1,150 @@
+#include "Trace.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static const uint32_t TraceMagic = 0x45534454; // "TDSE"
+
+// polling interval of the replay while the program has not written more
+static const useconds_t PollInterval = 50;
+
+TraceBuffer::~TraceBuffer() {
+  if (Header)
+    munmap(Header, Length);
+}
+
+bool TraceBuffer::map(int FD) {
+  void *Addr =
+      mmap(nullptr, Length, PROT_READ | PROT_WRITE, MAP_SHARED, FD, 0);
+  close(FD);
+  if (Addr == MAP_FAILED)
+    return false;
+  Header = (TraceHeader *)Addr;
+  Words = (int32_t *)(Header + 1);
+  return true;
+}
+
+bool TraceBuffer::create(const char *FileName, uint64_t Capacity) {
+  int FD = ::open(FileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (FD < 0)
+    return false;
+  Length = sizeof(TraceHeader) + Capacity * sizeof(int32_t);
+  if (ftruncate(FD, Length)) {
+    close(FD);
+    return false;
+  }
+  if (!map(FD))
+    return false;
+  Header->Capacity = Capacity;
+  reset();
+  Header->Magic = TraceMagic;
+  return true;
+}
+
+bool TraceBuffer::open(const char *FileName) {
+  int FD = ::open(FileName, O_RDWR);
+  if (FD < 0)
+    return false;
+  TraceHeader H;
+  if (pread(FD, &H, sizeof(H), 0) != sizeof(H) || H.Magic != TraceMagic) {
+    close(FD);
+    return false;
+  }
+  Length = sizeof(TraceHeader) + H.Capacity * sizeof(int32_t);
+  if (!map(FD))
+    return false;
+  Size = Header->Size;
+  return true;
+}
+
+void TraceBuffer::reset() {
+  Size = 0;
+  Header->Truncated = 0;
+  __atomic_store_n(&Header->Size, 0, __ATOMIC_RELEASE);
+}
+
+// replays the event at W and returns its number of words
+static int replayEvent(const int32_t *W, SymbolicInterpreter &SI) {
+  const int32_t *A = W + 1;
+  switch (W[0]) {
+  case InputEvent:
+    SI.visitInput(toAddr(A[0], A[1]), A[2], A[3]);
+    break;
+  case AllocaEvent:
+    SI.visitAlloca(A[0], toAddr(A[1], A[2]));
+    break;
+  case StoreEvent:
+    SI.visitStore(toAddr(A[0], A[1]), A[2], A[3]);
+    break;
+  case LoadEvent:
+    SI.visitLoad(A[0], toAddr(A[1], A[2]), A[3]);
+    break;
+  case ICmpEvent:
+    SI.visitICmp(A[0], A[1], A[2], A[3], A[4], A[5], A[6]);
+    break;
+  case BinOpEvent:
+    SI.visitBinOp(A[0], A[1], A[2], A[3], A[4], A[5]);
+    break;
+  case PhiEvent:
+    SI.visitPhi(A[0], A[1], A[2], A[3]);
+    break;
+  case SelectEvent:
+    SI.visitSelect(A[0], A[1], A[2], A[3], A[4], A[5], A[6]);
+    break;
+  case CastEvent:
+    SI.visitCast(A[0], A[1], A[2], A[3], A[4]);
+    break;
+  case ArgEvent:
+    SI.visitArg(A[0], A[1], A[2]);
+    break;
+  case ParamEvent:
+    SI.visitParam(A[0], A[1], A[2]);
+    break;
+  case ReturnEvent:
+    SI.visitReturn(A[0], A[1]);
+    break;
+  case CallResultEvent:
+    SI.visitCallResult(A[0], A[1]);
+    break;
+  case InputByteEvent:
+    SI.visitInputByte(toAddr(A[0], A[1]), A[2], A[3]);
+    break;
+  case LoadByteEvent:
+    SI.visitLoadByte(A[0], toAddr(A[1], A[2]), A[3]);
+    break;
+  case EnterEvent:
+    SI.visitEnter(A[0], A[1]);
+    break;
+  case LeaveEvent:
+    SI.visitLeave();
+    break;
+  default:
+    return 0;
+  }
+  return 1 + EventSize[W[0]];
+}
+
+void replayTrace(const TraceBuffer &Trace, SymbolicInterpreter &SI,
+                 const std::atomic<bool> &Done) {
+  const int32_t *Words = Trace.getWords();
+  uint64_t Pos = 0;
+  while (true) {
+    // Done is read before the size, so the events the program wrote before
+    // it exited are all seen
+    bool Exited = Done;
+    uint64_t Size = Trace.getSize();
+    if (Pos == Size) {
+      if (Exited)
+        return;
+      usleep(PollInterval);
+      continue;
+    }
+    while (Pos < Size) {
+      int N = replayEvent(Words + Pos, SI);
+      if (N == 0)
+        return;
+      Pos += N;
+    }
+  }
+}
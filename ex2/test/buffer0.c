@@ -0,0 +1,19 @@
+#include <stdio.h>
+
+#include "../include/Runtime.h"
+
+int main() {
+  char buf[4];
+  DSE_InputBuffer(buf, 4);
+
+  if (buf[0] == 'b') {
+	 if (buf[1] == 'u') {
+		if (buf[2] == 'g') {
+		  int x = buf[3] + 128;
+		  x = 1 / x;
+		}
+	 }
+  }
+
+  return 0;
+}
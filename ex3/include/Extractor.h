@@ -6,6 +6,7 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Type.h"
+#include <map>
 #include <set>
 
 #include "Utils.h"
@@ -17,7 +18,9 @@ using DefMapTy = std::map<Value *, std::set<Value *>>;
 
 class Extractor {
 public:
-  Extractor() : AllVariableVector(C), Queries(C) {
+  // With LargeBlock, only the entry, the loop headers and the blocks of
+  // assertion failures have relations, see Extractor::extractRegion.
+  Extractor(bool LargeBlock = false) : Queries(C), LargeBlock(LargeBlock) {
     Solver = new z3::fixedpoint(C);
     Params = new z3::params(C);
     Params->set("engine", "spacer");
@@ -29,26 +32,42 @@ public:
     delete Params;
   }
 
+  // Overrides the fixedpoint parameter Name, e.g. engine or xform.slice.
+  // The values true and false are Booleans and numerals are unsigned.
+  void setParam(const std::string &Name, const std::string &Value);
+
   z3::fixedpoint *getSolver() { return Solver; }
   z3::context &getContext() { return C; }
   z3::func_decl_vector &getQueries() { return Queries; }
 
-  void initialize(Function &F);
+  void initialize(Function &F, BasicBlock *Target = nullptr);
   void extractConstraints(Instruction *I, z3::expr_vector &Assertions);
   void extractConstraints(BasicBlock *BB);
   void addQuery(z3::func_decl &Q) { Queries.push_back(Q); }
   z3::expr_vector transition(BasicBlock *BB, BasicBlock *Succ);
+  bool hasRelation(BasicBlock *BB) { return BBRelations.count(BB); }
+  z3::func_decl &getRelation(BasicBlock *BB) { return BBRelations.at(BB); }
+  void extractRegion(BasicBlock *Head);
 
 private:
+  void addRule(const z3::expr &E);
+  z3::expr edgeCondition(BasicBlock *BB, BasicBlock *Succ);
+  z3::expr getPhiVariable(PHINode *Phi, bool Next);
+  z3::expr phiAssignment(BasicBlock *BB, BasicBlock *Succ, bool Next);
+
   z3::context C;
   z3::fixedpoint *Solver;
   z3::params *Params;
   z3::check_result Result;
   z3::func_decl_vector Queries;
+  bool LargeBlock;
+  // the variables live on entry to each block, see Extractor::initialize
   std::map<BasicBlock *, std::set<Value *>> FreeVariables;
   std::map<BasicBlock *, z3::func_decl> BBRelations;
+  std::set<unsigned> RelationIDs;
+  // the blocks that reach the target of a sliced query, empty if unsliced
+  std::set<BasicBlock *> Cone;
   std::map<BasicBlock *, z3::expr_vector> FreeVariableVector;
-  z3::expr_vector AllVariableVector;
 };
 
 #endif // EXTRACTOR_H
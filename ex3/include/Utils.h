@@ -9,6 +9,8 @@ std::string toString(Value *I);
 
 bool isAssertFail(CallInst *CI);
 
+bool hasAssertFail(BasicBlock &BB);
+
 bool isAssume(CallInst *CI);
 
 #endif // UTILS_H
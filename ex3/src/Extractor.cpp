@@ -1,8 +1,10 @@
 #include "Extractor.h"
 
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/CFG.h"
 #include "llvm/IR/Instruction.h"
 #include <algorithm>
+#include <cctype>
 
 #include "Utils.h"
 
@@ -28,10 +30,9 @@ z3::expr eval(z3::context &C, Value *V) {
 // This function encodes an individual instruction I.
 void Extractor::extractConstraints(Instruction *I,
                                    z3::expr_vector &Assertions) {
-  z3::func_decl NodeRel = BBRelations.at(I->getParent());
   if (CallInst *CI = dyn_cast<CallInst>(I)) {
     if (isAssertFail(CI)) {
-      addQuery(NodeRel);
+      addQuery(BBRelations.at(I->getParent()));
     } else if (isAssume(CI)) {
       z3::expr X = eval(C, CI->getArgOperand(0));
       Assertions.push_back(X > 0);
@@ -115,40 +116,159 @@ bool isVariable(Value *V) {
 
 bool isPHINode(Value *V) { return isa<PHINode>(V); }
 
-// In this function, the main tasks are collecting variables, computing free
-// variables, etc., and adding them to the solver. The data structures that are
-// used in this function are defined in Extractor.h.
-void Extractor::initialize(Function &F) {
-  std::set<Value *> AllVariables;
-  z3::sort_vector SortVector(C);
+// whether V is a variable that relations range over, an integer or a Boolean
+// instruction or argument
+bool isEncoded(Value *V) {
+  return (isa<Instruction>(V) || isa<Argument>(V)) && isVariable(V) &&
+         (V->getType()->isIntegerTy(32) || V->getType()->isIntegerTy(1));
+}
+
+// Computes the variables live on entry to each block of F. A variable is live
+// on entry to a block that uses it before any definition, and to every block
+// on a path from there back to its definition. In SSA form the only
+// definitions a block can see first are its own, and a PHI node uses its
+// incoming value at the end of the incoming block instead of in its own block.
+std::map<BasicBlock *, std::set<Value *>> computeLiveIn(Function &F) {
+  std::map<BasicBlock *, std::set<Value *>> Uses;
   for (auto &BB : F) {
+    std::set<Value *> &BBUses = Uses[&BB];
     for (auto &I : BB) {
-      if (isVariable(&I) || isPHINode(&I)) {
-        AllVariables.insert(&I);
-        if (I.getType()->isIntegerTy(32)) {
-          SortVector.push_back(C.int_sort());
-          AllVariableVector.push_back(C.int_const(toString(&I).c_str()));
-        } else if (I.getType()->isIntegerTy(1)) {
-          SortVector.push_back(C.bool_sort());
-          AllVariableVector.push_back(C.bool_const(toString(&I).c_str()));
-        }
+      if (isPHINode(&I))
+        continue;
+      for (Value *Op : I.operands()) {
+        Instruction *Def = dyn_cast<Instruction>(Op);
+        if (isEncoded(Op) && (!Def || Def->getParent() != &BB))
+          BBUses.insert(Op);
       }
     }
   }
 
-  for (auto &BB : F) {
-    std::set<Value *> BindVars;
-    for (auto &I : BB) {
-      if (isVariable(&I) && !isPHINode(&I)) {
-        BindVars.insert(&I);
+  std::map<BasicBlock *, std::set<Value *>> LiveIn;
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    // blocks are mostly visited after their successors
+    for (auto &Block : reverse(F.getBasicBlockList())) {
+      BasicBlock *BB = &Block;
+      std::set<Value *> Live = Uses[BB];
+      for (BasicBlock *Succ : successors(BB)) {
+        for (Value *V : LiveIn[Succ]) {
+          Instruction *Def = dyn_cast<Instruction>(V);
+          if (!Def || Def->getParent() != BB)
+            Live.insert(V);
+        }
+        for (auto &Phi : Succ->phis()) {
+          Value *V = Phi.getIncomingValueForBlock(BB);
+          Instruction *Def = dyn_cast<Instruction>(V);
+          if (isEncoded(V) && (!Def || Def->getParent() != BB))
+            Live.insert(V);
+        }
+      }
+      if (Live.size() != LiveIn[BB].size()) {
+        LiveIn[BB] = Live;
+        Changed = true;
       }
     }
-    // free variable here means the variables outside the current basic block
-    // and PHI nodes
+  }
+  return LiveIn;
+}
+
+// Collects the targets of the back edges found by a depth-first search from
+// BB, i.e. the loop headers.
+void findLoopHeaders(BasicBlock *BB, std::set<BasicBlock *> &Visited,
+                     std::set<BasicBlock *> &OnStack,
+                     std::set<BasicBlock *> &Headers) {
+  Visited.insert(BB);
+  OnStack.insert(BB);
+  for (BasicBlock *Succ : successors(BB)) {
+    if (OnStack.count(Succ))
+      Headers.insert(Succ);
+    else if (!Visited.count(Succ))
+      findLoopHeaders(Succ, Visited, OnStack, Headers);
+  }
+  OnStack.erase(BB);
+}
+
+// Appends the blocks reachable from BB without entering a cut point or
+// leaving the cone Cone, if any, to Order, each after its successors.
+void sortRegion(BasicBlock *BB,
+                const std::map<BasicBlock *, z3::func_decl> &CutPoints,
+                const std::set<BasicBlock *> &Cone,
+                std::set<BasicBlock *> &Visited,
+                std::vector<BasicBlock *> &Order) {
+  Visited.insert(BB);
+  for (BasicBlock *Succ : successors(BB)) {
+    if (!CutPoints.count(Succ) && !Visited.count(Succ) &&
+        (Cone.empty() || Cone.count(Succ)))
+      sortRegion(Succ, CutPoints, Cone, Visited, Order);
+  }
+  Order.push_back(BB);
+}
+
+// the blocks from which Target is reachable
+std::set<BasicBlock *> computeCone(BasicBlock *Target) {
+  std::set<BasicBlock *> Cone = {Target};
+  std::vector<BasicBlock *> Worklist = {Target};
+  while (!Worklist.empty()) {
+    BasicBlock *BB = Worklist.back();
+    Worklist.pop_back();
+    for (BasicBlock *Pred : predecessors(BB)) {
+      if (Cone.insert(Pred).second)
+        Worklist.push_back(Pred);
+    }
+  }
+  return Cone;
+}
+
+// the variables of the encoding that occur in E, i.e. its constants other
+// than the nullary relations Relations
+z3::expr_vector getVariables(z3::context &C, const z3::expr &E,
+                             const std::set<unsigned> &Relations) {
+  z3::expr_vector Vars(C);
+  std::set<unsigned> Visited;
+  std::vector<z3::expr> Stack = {E};
+  while (!Stack.empty()) {
+    z3::expr X = Stack.back();
+    Stack.pop_back();
+    if (!X.is_app() || !Visited.insert(X.id()).second)
+      continue;
+    if (X.is_const() && X.decl().decl_kind() == Z3_OP_UNINTERPRETED) {
+      if (!Relations.count(X.decl().id()))
+        Vars.push_back(X);
+      continue;
+    }
+    for (unsigned I = 0; I < X.num_args(); I++)
+      Stack.push_back(X.arg(I));
+  }
+  return Vars;
+}
+
+// In this function, the main tasks are collecting variables, computing free
+// variables, etc., and adding them to the solver. The data structures that are
+// used in this function are defined in Extractor.h. With a Target, only the
+// blocks that reach it are encoded, and its assertion is the only query.
+void Extractor::initialize(Function &F, BasicBlock *Target) {
+  std::map<BasicBlock *, std::set<Value *>> LiveIn = computeLiveIn(F);
+  Cone.clear();
+  if (Target)
+    Cone = computeCone(Target);
+  // the cut points of the large-block encoding
+  std::set<BasicBlock *> Headers, Visited, OnStack;
+  findLoopHeaders(&F.getEntryBlock(), Visited, OnStack, Headers);
+  for (auto &BB : F) {
+    if (Target && !Cone.count(&BB))
+      continue;
+    if (LargeBlock && &BB != &F.getEntryBlock() && !Headers.count(&BB) &&
+        !hasAssertFail(BB))
+      continue;
+    // free variable here means the variables live on entry to the block and
+    // its PHI nodes, whose values the predecessors pass in
     std::set<Value *> &FreeVars = FreeVariables[&BB];
-    std::set_difference(AllVariables.begin(), AllVariables.end(),
-                        BindVars.begin(), BindVars.end(),
-                        std::inserter(FreeVars, FreeVars.begin()));
+    FreeVars = LiveIn[&BB];
+    for (auto &Phi : BB.phis()) {
+      if (isEncoded(&Phi))
+        FreeVars.insert(&Phi);
+    }
     z3::sort_vector SortVector(C);
     z3::expr_vector VariableVector(C);
     for (auto &V : FreeVars) {
@@ -165,41 +285,146 @@ void Extractor::initialize(Function &F) {
     z3::func_decl NodeRel =
         C.function(BB.getName().str().c_str(), SortVector, C.bool_sort());
     Solver->register_relation(NodeRel);
+    RelationIDs.insert(NodeRel.id());
     BBRelations.insert(std::make_pair(&BB, NodeRel));
   }
   // define the entry rule
   BasicBlock *Entry = &F.getEntryBlock();
+  if (!BBRelations.count(Entry))
+    return;
   z3::func_decl Rel = BBRelations.at(Entry);
   z3::expr_vector Vec = FreeVariableVector.at(Entry);
   try {
-    z3::expr R0 = z3::forall(Vec, Rel(Vec));
-    Solver->add_rule(R0, C.str_symbol(""));
+    addRule(Rel(Vec));
   } catch (z3::exception e) {
     std::cerr << "z3::exception: " << e.msg() << std::endl;
   }
 }
 
+void Extractor::setParam(const std::string &Name, const std::string &Value) {
+  if (Value == "true" || Value == "false")
+    Params->set(Name.c_str(), Value == "true");
+  else if (!Value.empty() &&
+           std::all_of(Value.begin(), Value.end(), ::isdigit))
+    Params->set(Name.c_str(), (unsigned)std::stoul(Value));
+  else
+    Params->set(Name.c_str(), Value.c_str());
+  Solver->set(*Params);
+}
+
+// Adds the rule E, quantified over the variables it mentions.
+void Extractor::addRule(const z3::expr &E) {
+  z3::expr_vector Vars = getVariables(C, E, RelationIDs);
+  z3::expr Rule = Vars.empty() ? E : z3::forall(Vars, E);
+  Solver->add_rule(Rule, C.str_symbol(""));
+}
+
 // get the free variable of Succ with the affect from BB
 z3::expr_vector Extractor::transition(BasicBlock *BB, BasicBlock *Succ) {
   z3::expr_vector Vec(C);
   int Idx = 0;
   for (auto &FV : FreeVariables[Succ]) {
-    if (PHINode *Phi = dyn_cast<PHINode>(FV)) {
-      // This free variable is a phinode of either Succ or some other blocks
-      if (Phi->getBasicBlockIndex(BB) >= 0) {
-        // substitude the free variable with its source variable from BB
-        z3::expr E = eval(C, Phi->getIncomingValueForBlock(BB));
-        Vec.push_back(E);
-        Idx++;
-        continue;
-      }
+    PHINode *Phi = dyn_cast<PHINode>(FV);
+    if (Phi && Phi->getParent() == Succ) {
+      // substitude the PHI node of Succ with its source variable from BB
+      Vec.push_back(eval(C, Phi->getIncomingValueForBlock(BB)));
+    } else {
+      Vec.push_back(FreeVariableVector.at(Succ)[Idx]);
     }
-    Vec.push_back(FreeVariableVector.at(Succ)[Idx]);
     Idx++;
   }
   return Vec;
 }
 
+// the condition under which BB branches to Succ
+z3::expr Extractor::edgeCondition(BasicBlock *BB, BasicBlock *Succ) {
+  BranchInst *BI = dyn_cast<BranchInst>(BB->getTerminator());
+  if (!BI || BI->isUnconditional() ||
+      BI->getSuccessor(0) == BI->getSuccessor(1))
+    return C.bool_val(true);
+  z3::expr CondExpr = C.bool_const(toString(BI->getCondition()).c_str());
+  return BI->getSuccessor(0) == Succ ? CondExpr : !CondExpr;
+}
+
+// the variable of the PHI node Phi, or the variable of its next value when
+// Next is set, to tell them apart in a rule that leads back to their block
+z3::expr Extractor::getPhiVariable(PHINode *Phi, bool Next) {
+  std::string Name = toString(Phi) + (Next ? "'" : "");
+  if (Phi->getType()->isIntegerTy(1))
+    return C.bool_const(Name.c_str());
+  return C.int_const(Name.c_str());
+}
+
+// the values that the PHI nodes of Succ take when BB branches to it
+z3::expr Extractor::phiAssignment(BasicBlock *BB, BasicBlock *Succ,
+                                  bool Next) {
+  z3::expr_vector Assignment(C);
+  for (auto &Phi : Succ->phis()) {
+    if (isEncoded(&Phi))
+      Assignment.push_back(getPhiVariable(&Phi, Next) ==
+                           eval(C, Phi.getIncomingValueForBlock(BB)));
+  }
+  return z3::mk_and(Assignment);
+}
+
+// Encodes the region of blocks from the cut point Head up to the next cut
+// points, with one rule per cut point it reaches. The region is loop-free,
+// and the formula of each of its blocks is the disjunction of the paths from
+// Head to the block, so the rules grow with the blocks of the region rather
+// than with its paths.
+void Extractor::extractRegion(BasicBlock *Head) {
+  std::set<BasicBlock *> Visited;
+  std::vector<BasicBlock *> Order;
+  sortRegion(Head, BBRelations, Cone, Visited, Order);
+
+  std::map<BasicBlock *, z3::expr> Paths;
+  std::vector<BasicBlock *> Targets;
+  for (BasicBlock *BB : reverse(Order)) {
+    z3::expr_vector Assertions(C);
+    if (BB == Head) {
+      Assertions.push_back(BBRelations.at(BB)(FreeVariableVector.at(BB)));
+    } else {
+      z3::expr_vector Entries(C);
+      for (BasicBlock *Pred : predecessors(BB)) {
+        if (Paths.count(Pred))
+          Entries.push_back(Paths.at(Pred) && edgeCondition(Pred, BB) &&
+                            phiAssignment(Pred, BB, false));
+      }
+      Assertions.push_back(z3::mk_or(Entries));
+    }
+    for (auto &I : *BB) {
+      extractConstraints(&I, Assertions);
+    }
+    Paths.insert(std::make_pair(BB, z3::mk_and(Assertions)));
+    for (BasicBlock *Succ : successors(BB)) {
+      if (BBRelations.count(Succ) &&
+          std::find(Targets.begin(), Targets.end(), Succ) == Targets.end())
+        Targets.push_back(Succ);
+    }
+  }
+
+  for (BasicBlock *Succ : Targets) {
+    z3::expr_vector Entries(C);
+    for (BasicBlock *Pred : predecessors(Succ)) {
+      if (Paths.count(Pred))
+        Entries.push_back(Paths.at(Pred) && edgeCondition(Pred, Succ) &&
+                          phiAssignment(Pred, Succ, true));
+    }
+    // the PHI nodes of Succ take their next values
+    z3::expr_vector Vec(C);
+    int Idx = 0;
+    for (auto &FV : FreeVariables[Succ]) {
+      PHINode *Phi = dyn_cast<PHINode>(FV);
+      if (Phi && Phi->getParent() == Succ)
+        Vec.push_back(getPhiVariable(Phi, true));
+      else
+        Vec.push_back(FreeVariableVector.at(Succ)[Idx]);
+      Idx++;
+    }
+    addRule(z3::implies(z3::mk_or(Entries), BBRelations.at(Succ)(Vec)));
+  }
+}
+
 // This function encodes the basic block BB as Constrained Horn Clause.
 void Extractor::extractConstraints(BasicBlock *BB) {
   z3::func_decl &BBRel = BBRelations.at(BB);
@@ -221,12 +446,13 @@ void Extractor::extractConstraints(BasicBlock *BB) {
   if (BranchInst *BI = dyn_cast<BranchInst>(&BB->back())) {
     if (BI->isUnconditional()) {
       BasicBlock *Succ = BI->getSuccessor(0);
+      // successors outside the cone of a sliced query have no relation
+      if (!BBRelations.count(Succ))
+        return;
       z3::func_decl &SuccRel = BBRelations.at(Succ);
       z3::expr_vector TPropagation = transition(BB, Succ);
       z3::expr SuccTuple = SuccRel(TPropagation);
-      z3::expr R0 =
-          z3::forall(AllVariableVector, z3::implies(BBTuple && And, SuccTuple));
-      Solver->add_rule(R0, C.str_symbol(""));
+      addRule(z3::implies(BBTuple && And, SuccTuple));
     } else {
       std::string Cond = toString(BI->getCondition());
       z3::expr CondExpr = C.bool_const(Cond.c_str());
@@ -238,23 +464,21 @@ void Extractor::extractConstraints(BasicBlock *BB) {
 
       // True Branch
       BasicBlock *TSucc = BI->getSuccessor(0);
-      z3::func_decl &TSuccRel = BBRelations.at(TSucc);
-      z3::expr_vector TPropagation = transition(BB, TSucc);
-      z3::expr TSuccTuple = TSuccRel(TPropagation);
-      z3::expr TR0 =
-          z3::forall(AllVariableVector,
-                     z3::implies(CondExpr && BBTuple && And, TSuccTuple));
-      Solver->add_rule(TR0, C.str_symbol(""));
+      if (BBRelations.count(TSucc)) {
+        z3::func_decl &TSuccRel = BBRelations.at(TSucc);
+        z3::expr_vector TPropagation = transition(BB, TSucc);
+        z3::expr TSuccTuple = TSuccRel(TPropagation);
+        addRule(z3::implies(CondExpr && BBTuple && And, TSuccTuple));
+      }
 
       // False Branch
       BasicBlock *FSucc = BI->getSuccessor(1);
-      z3::func_decl &FSuccRel = BBRelations.at(FSucc);
-      z3::expr_vector FPropagation = transition(BB, FSucc);
-      z3::expr FSuccTuple = FSuccRel(FPropagation);
-      z3::expr FR0 =
-          z3::forall(AllVariableVector,
-                     z3::implies(!CondExpr && BBTuple && And, FSuccTuple));
-      Solver->add_rule(FR0, C.str_symbol(""));
+      if (BBRelations.count(FSucc)) {
+        z3::func_decl &FSuccRel = BBRelations.at(FSucc);
+        z3::expr_vector FPropagation = transition(BB, FSucc);
+        z3::expr FSuccTuple = FSuccRel(FPropagation);
+        addRule(z3::implies(!CondExpr && BBTuple && And, FSuccTuple));
+      }
     }
   }
 }
\ No newline at end of file
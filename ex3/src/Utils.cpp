@@ -16,6 +16,15 @@ bool isAssertFail(CallInst *CI) {
   return CI->getCalledFunction()->getName().equals("__assert_fail");
 }
 
+bool hasAssertFail(BasicBlock &BB) {
+  for (auto &I : BB) {
+    CallInst *CI = dyn_cast<CallInst>(&I);
+    if (CI && isAssertFail(CI))
+      return true;
+  }
+  return false;
+}
+
 bool isAssume(CallInst *CI) {
   return CI->getCalledFunction()->getName().equals("assume");
 }
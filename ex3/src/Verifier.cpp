@@ -1,22 +1,306 @@
 #include "llvm/AsmParser/Parser.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/SourceMgr.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
+#include <mutex>
+#include <thread>
 
 #include "Extractor.h"
 
 using namespace llvm;
 
-int main(int argc, char **argv) {
-  if (argc > 3) {
-    errs() << "Expected an argument - IR file name\n";
-    exit(1);
+static cl::opt<std::string> FileName(cl::Positional, cl::Required,
+                                     cl::desc("<IR file>"));
+static cl::opt<bool>
+    LargeBlock("lbe", cl::desc("Encode the loop-free regions between loop "
+                               "headers and assertions as single rules"));
+static cl::opt<bool>
+    PerAssertion("per-assertion",
+                 cl::desc("Verify each assertion with a query of its own"));
+static cl::opt<unsigned>
+    NumThreads("j", cl::init(0),
+               cl::desc("Threads of -per-assertion, 0 for one per core"));
+static cl::list<std::string>
+    ConfigNames("config", cl::CommaSeparated,
+                cl::desc("Engine configurations, several race in a portfolio"));
+static cl::opt<bool> Portfolio("portfolio",
+                               cl::desc("Race all engine configurations"));
+static cl::opt<std::string>
+    PortfolioLog("portfolio-log", cl::init(""),
+                 cl::desc("Append the winning configuration of each query "
+                          "to this file"));
+static cl::opt<bool>
+    Slice("slice", cl::desc("Encode only the blocks that reach the assertion "
+                            "of each -per-assertion query"));
+
+// Encodes the functions of M, or with a Target only the blocks of its
+// function that reach it.
+static void encode(Module &M, Extractor &Ext, BasicBlock *Target) {
+  for (auto &F : M) {
+    if (F.size() == 0 || (Target && Target->getParent() != &F))
+      continue;
+    Ext.initialize(F, Target);
+    for (auto &BB : F) {
+      if (!Ext.hasRelation(&BB))
+        continue;
+      if (LargeBlock)
+        Ext.extractRegion(&BB);
+      else
+        Ext.extractConstraints(&BB);
+    }
+  }
+}
+
+// A configuration of the fixedpoint engine, as the parameters that differ
+// from the defaults of Extractor.
+struct EngineConfig {
+  const char *Name;
+  std::vector<std::pair<const char *, const char *>> Params;
+};
+
+static const std::vector<EngineConfig> Configs = {
+    {"spacer", {}},
+    {"spacer-no-inline",
+     {{"xform.inline_linear", "false"}, {"xform.inline_eager", "false"}}},
+    {"spacer-no-slice", {{"xform.slice", "false"}}},
+    {"spacer-gpdr", {{"spacer.gpdr", "true"}}},
+    {"spacer-random",
+     {{"spacer.random_seed", "7"}, {"spacer.order_children", "2"}}},
+    {"bmc", {{"engine", "bmc"}}},
+};
+
+// an assertion by the positions of its function and block in the module
+using AssertionTy = std::pair<unsigned, unsigned>;
+
+// The configurations racing on a query. The first definite answer wins and
+// interrupts the contexts of the others.
+class Race {
+public:
+  // Runs each configuration on a thread of its own and returns the answer
+  // of the winner, or unknown if none gives one.
+  z3::check_result run(const AssertionTy *A,
+                       const std::vector<const EngineConfig *> &Entrants);
+  const char *getWinner() const { return Winner; }
+
+  // Registers the context C of an entrant before its query. Returns false
+  // once the race is over.
+  bool enter(z3::context &C);
+  void leave(z3::context &C);
+  bool isOver() {
+    std::lock_guard<std::mutex> Guard(Lock);
+    return Winner != nullptr;
   }
 
+private:
+  void finish(const EngineConfig &Config, z3::check_result R);
+
+  std::mutex Lock;
+  std::condition_variable Finished;
+  std::set<z3::context *> Contexts;
+  unsigned Running = 0;
+  z3::check_result Result = z3::unknown;
+  const char *Winner = nullptr;
+};
+
+// Verifies the assertion A, or all assertions without one, in a module and
+// a Z3 context of its own, so that queries can run on different threads.
+// Contexts that take part in the race R are registered with it.
+static z3::check_result verify(const AssertionTy *A,
+                               const EngineConfig &Config, Race *R) {
+  LLVMContext Context;
+  SMDiagnostic Err;
+  std::unique_ptr<Module> Mod = parseAssemblyFile(FileName, Err, Context);
+  if (!Mod)
+    return z3::unknown;
+  BasicBlock *Target = nullptr;
+  if (A) {
+    Function &F = *std::next(Mod->begin(), A->first);
+    Target = &*std::next(F.begin(), A->second);
+  }
+
+  Extractor Ext(LargeBlock);
+  for (auto &P : Config.Params)
+    Ext.setParam(P.first, P.second);
+  encode(*Mod, Ext, Slice ? Target : nullptr);
+  z3::func_decl_vector Query = Ext.getQueries();
+  if (Target) {
+    Query = z3::func_decl_vector(Ext.getContext());
+    Query.push_back(Ext.getRelation(Target));
+  }
+
+  if (R && !R->enter(Ext.getContext()))
+    return z3::unknown;
+  z3::check_result Result = z3::unknown;
+  try {
+    Result = Ext.getSolver()->query(Query);
+  } catch (const z3::exception &e) {
+    // the losers of a race are interrupted
+    if (!R || !R->isOver())
+      std::cerr << Config.Name << ": z3::exception: " << e.msg() << std::endl;
+  }
+  if (R)
+    R->leave(Ext.getContext());
+  return Result;
+}
+
+bool Race::enter(z3::context &C) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  if (Winner)
+    return false;
+  Contexts.insert(&C);
+  return true;
+}
+
+void Race::leave(z3::context &C) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  Contexts.erase(&C);
+}
+
+void Race::finish(const EngineConfig &Config, z3::check_result R) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  Running--;
+  if (!Winner && R != z3::unknown) {
+    Winner = Config.Name;
+    Result = R;
+  }
+  Finished.notify_all();
+}
+
+z3::check_result Race::run(const AssertionTy *A,
+                           const std::vector<const EngineConfig *> &Entrants) {
+  Running = Entrants.size();
+  std::vector<std::thread> Threads;
+  for (const EngineConfig *Config : Entrants) {
+    Threads.emplace_back([this, A, Config]() {
+      z3::check_result R = z3::unknown;
+      try {
+        R = verify(A, *Config, this);
+      } catch (const z3::exception &e) {
+        std::cerr << Config->Name << ": z3::exception: " << e.msg()
+                  << std::endl;
+      }
+      finish(*Config, R);
+    });
+  }
+  {
+    std::unique_lock<std::mutex> Guard(Lock);
+    while (Running > 0) {
+      // An interrupt only stops a query that has started, so the losers
+      // are interrupted until they all return.
+      if (Winner) {
+        for (z3::context *C : Contexts)
+          C->interrupt();
+      }
+      Finished.wait_for(Guard, std::chrono::milliseconds(10));
+    }
+  }
+  for (auto &T : Threads)
+    T.join();
+  return Result;
+}
+
+// the configurations selected by -config and -portfolio
+static std::vector<const EngineConfig *> getEntrants() {
+  std::vector<const EngineConfig *> Entrants;
+  for (const EngineConfig &Config : Configs) {
+    if (Portfolio || std::find(ConfigNames.begin(), ConfigNames.end(),
+                               Config.Name) != ConfigNames.end())
+      Entrants.push_back(&Config);
+  }
+  if (Entrants.empty() && ConfigNames.empty())
+    Entrants.push_back(&Configs[0]);
+  return Entrants;
+}
+
+// Answers the query of the assertion A, or of all assertions, with the
+// selected configurations, and logs the winner if they race.
+static z3::check_result solve(const AssertionTy *A, const std::string &Name,
+                              std::string &Winner) {
+  std::vector<const EngineConfig *> Entrants = getEntrants();
+  if (Entrants.size() == 1) {
+    Winner = Entrants[0]->Name;
+    return verify(A, *Entrants[0], nullptr);
+  }
+  auto Start = std::chrono::steady_clock::now();
+  Race R;
+  z3::check_result Result = R.run(A, Entrants);
+  std::chrono::duration<double> Elapsed =
+      std::chrono::steady_clock::now() - Start;
+  Winner = R.getWinner() ? R.getWinner() : "none";
+  if (!PortfolioLog.empty()) {
+    static std::mutex LogLock;
+    std::lock_guard<std::mutex> Guard(LogLock);
+    std::ofstream Log(PortfolioLog, std::ios::app);
+    Log << FileName << "\t" << Name << "\t" << Winner << "\t" << Result
+        << "\t" << Elapsed.count() << std::endl;
+  }
+  return Result;
+}
+
+// Verifies each assertion of M on a pool of NumThreads threads and prints
+// the results as they finish. Returns sat if any assertion fails, unsat if
+// all hold and unknown otherwise.
+static z3::check_result verifyEach(Module &M) {
+  std::vector<AssertionTy> Assertions;
+  std::vector<std::string> Names;
+  unsigned FIdx = 0;
+  for (auto &F : M) {
+    unsigned BIdx = 0;
+    for (auto &BB : F) {
+      if (hasAssertFail(BB)) {
+        Assertions.push_back(std::make_pair(FIdx, BIdx));
+        Names.push_back(F.getName().str() + ":" + BB.getName().str());
+      }
+      BIdx++;
+    }
+    FIdx++;
+  }
+
+  std::atomic<unsigned> Next(0);
+  std::mutex Lock;
+  z3::check_result Result = z3::unsat;
+  auto Worker = [&]() {
+    for (unsigned I = Next++; I < Assertions.size(); I = Next++) {
+      auto Start = std::chrono::steady_clock::now();
+      z3::check_result R = z3::unknown;
+      std::string Winner;
+      try {
+        R = solve(&Assertions[I], Names[I], Winner);
+      } catch (const z3::exception &e) {
+        std::lock_guard<std::mutex> Guard(Lock);
+        std::cerr << "z3::exception: " << e.msg() << std::endl;
+      }
+      std::chrono::duration<double> Elapsed =
+          std::chrono::steady_clock::now() - Start;
+      std::lock_guard<std::mutex> Guard(Lock);
+      std::cout << Names[I] << " " << R << " " << Elapsed.count() << "s "
+                << Winner << std::endl;
+      if (R == z3::sat || (R == z3::unknown && Result == z3::unsat))
+        Result = R;
+    }
+  };
+
+  unsigned N = NumThreads ? NumThreads : std::thread::hardware_concurrency();
+  N = std::max(1u, std::min<unsigned>(N, Assertions.size()));
+  std::vector<std::thread> Pool;
+  for (unsigned I = 0; I < N; I++)
+    Pool.emplace_back(Worker);
+  for (auto &T : Pool)
+    T.join();
+  return Result;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "CHC-based verifier\n");
+
   LLVMContext Context;
   SMDiagnostic Err;
-  StringRef FileName(argv[1]);
 
   std::unique_ptr<Module> Mod = parseAssemblyFile(FileName, Err, Context);
 
@@ -25,19 +309,35 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  Extractor Ext;
-  z3::fixedpoint *Solver = Ext.getSolver();
-  z3::context &C = Ext.getContext();
+  std::vector<const EngineConfig *> Entrants = getEntrants();
+  if (!Portfolio && !ConfigNames.empty() &&
+      Entrants.size() != ConfigNames.size()) {
+    errs() << "Unknown engine configuration, expected one of:";
+    for (const EngineConfig &Config : Configs)
+      errs() << " " << Config.Name;
+    errs() << "\n";
+    return 1;
+  }
 
-  for (auto &F : *Mod) {
-    if (F.size() == 0)
-      continue;
-    Ext.initialize(F);
-    for (auto &BB : F) {
-      Ext.extractConstraints(&BB);
-    }
+  if (PerAssertion) {
+    std::cout << verifyEach(*Mod) << std::endl;
+    return 0;
   }
 
+  if (Entrants.size() > 1) {
+    std::string Winner;
+    z3::check_result R = solve(nullptr, "all", Winner);
+    std::cout << "winner: " << Winner << std::endl;
+    std::cout << R << std::endl;
+    return 0;
+  }
+
+  Extractor Ext(LargeBlock);
+  for (auto &P : Entrants[0]->Params)
+    Ext.setParam(P.first, P.second);
+  z3::fixedpoint *Solver = Ext.getSolver();
+  encode(*Mod, Ext, nullptr);
+
   std::ofstream smt2("formula.smt2");
   smt2 << Solver->to_string() << std::endl;
   smt2 << ";;; query" << std::endl;